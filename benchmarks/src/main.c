@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file main.c
+ * @brief Runs each benchmark script to completion and reports its time
+ */
+
+#include <zephyr/kernel.h>
+#include <hako/loader.h>
+#include <mrubyc.h>
+
+#include "benchmarks_registry.h"
+
+int main(void)
+{
+    int ret = hako_init();
+    if (ret < 0) {
+        printk("hako_init failed: %d\n", ret);
+        return ret;
+    }
+
+    printk("%-16s %12s\n", "benchmark", "time (us)");
+
+    for (size_t i = 0; i < hako_benchmarks_registry_count; i++) {
+        const struct hako_bytecode_entry *bm = &hako_benchmarks_registry[i];
+
+        ret = hako_load_bytecode(bm->name, bm->bytecode);
+        if (ret < 0) {
+            printk("%-16s load failed: %d\n", bm->name, ret);
+            continue;
+        }
+
+        /* The VM thread is not started; mrbc_run() returns once the task ends */
+        uint32_t start = k_cycle_get_32();
+        mrbc_run();
+        uint32_t cycles = k_cycle_get_32() - start;
+
+        printk("%-16s %12u\n", bm->name, k_cyc_to_us_floor32(cycles));
+    }
+
+    return 0;
+}
@@ -0,0 +1,8 @@
+# Integer arithmetic and comparisons: ADD/SUB/MUL/DIV/LT dominate
+i = 0
+acc = 0
+while i < 200_000
+  acc = (acc + i * 3 - i / 7) % 65_521
+  i += 1
+end
+puts acc
@@ -0,0 +1,111 @@
+# case/when dispatch over 4, 16 and 64 Integer arms (message-type decoding)
+def case4(x)
+  case x
+  when 0 then 1
+  when 3 then 2
+  when 6 then 3
+  when 9 then 4
+  else 0
+  end
+end
+
+def case16(x)
+  case x
+  when 0 then 1
+  when 3 then 2
+  when 6 then 3
+  when 9 then 4
+  when 12 then 5
+  when 15 then 6
+  when 18 then 7
+  when 21 then 8
+  when 24 then 9
+  when 27 then 10
+  when 30 then 11
+  when 33 then 12
+  when 36 then 13
+  when 39 then 14
+  when 42 then 15
+  when 45 then 16
+  else 0
+  end
+end
+
+def case64(x)
+  case x
+  when 0 then 1
+  when 3 then 2
+  when 6 then 3
+  when 9 then 4
+  when 12 then 5
+  when 15 then 6
+  when 18 then 7
+  when 21 then 8
+  when 24 then 9
+  when 27 then 10
+  when 30 then 11
+  when 33 then 12
+  when 36 then 13
+  when 39 then 14
+  when 42 then 15
+  when 45 then 16
+  when 48 then 17
+  when 51 then 18
+  when 54 then 19
+  when 57 then 20
+  when 60 then 21
+  when 63 then 22
+  when 66 then 23
+  when 69 then 24
+  when 72 then 25
+  when 75 then 26
+  when 78 then 27
+  when 81 then 28
+  when 84 then 29
+  when 87 then 30
+  when 90 then 31
+  when 93 then 32
+  when 96 then 33
+  when 99 then 34
+  when 102 then 35
+  when 105 then 36
+  when 108 then 37
+  when 111 then 38
+  when 114 then 39
+  when 117 then 40
+  when 120 then 41
+  when 123 then 42
+  when 126 then 43
+  when 129 then 44
+  when 132 then 45
+  when 135 then 46
+  when 138 then 47
+  when 141 then 48
+  when 144 then 49
+  when 147 then 50
+  when 150 then 51
+  when 153 then 52
+  when 156 then 53
+  when 159 then 54
+  when 162 then 55
+  when 165 then 56
+  when 168 then 57
+  when 171 then 58
+  when 174 then 59
+  when 177 then 60
+  when 180 then 61
+  when 183 then 62
+  when 186 then 63
+  when 189 then 64
+  else 0
+  end
+end
+
+sum = 0
+i = 0
+while i < 20000
+  k = i % 200
+  sum += case4(k) + case16(k) + case64(k)
+  i += 1
+end
+puts sum
@@ -0,0 +1,19 @@
+# 10,000 monotonic clock and cycle counter reads, 2,000 Benchmark timings
+count = 0
+last = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+i = 0
+while i < 10000
+  now = Process.clock_gettime(Process::CLOCK_MONOTONIC, :nanosecond)
+  count += 1 if now >= last
+  last = now
+  count += 1 if VM.cycles >= 0
+  i += 1
+end
+
+i = 0
+while i < 1000
+  count += 1 if Benchmark.measure { i * 3 }.nanoseconds >= 0
+  count += 1 if Benchmark.realtime { i + 1 } >= 0
+  i += 1
+end
+puts count
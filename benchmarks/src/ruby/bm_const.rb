@@ -0,0 +1,19 @@
+# Constant reads in a loop: top-level GETCONST and scoped GETMCNST
+module Config
+  SCALE = 3
+
+  module Limits
+    MAX = 1000
+  end
+end
+
+OFFSET = 7
+
+i = 0
+acc = 0
+while i < 100_000
+  acc += Config::SCALE + OFFSET
+  acc -= Config::Limits::MAX if acc > Config::Limits::MAX
+  i += 1
+end
+puts acc
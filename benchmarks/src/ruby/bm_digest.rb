@@ -0,0 +1,20 @@
+# CRC-16, CRC-32, SHA-256 and HMAC-SHA256 over 64 KB each, in 4 KB blocks
+block = "frame 0123456789 abcdefghij ok\n" * 132
+key = "device-secret-0001"
+
+sum = 0
+sha = Digest::SHA256.new
+i = 0
+while i < 16
+  sum += Digest::CRC16.checksum(block)
+  sum += Digest::CRC32.checksum(block) & 0xffff
+  j = 0
+  while j < block.size
+    sha << block[j, 512]
+    j += 512
+  end
+  sum += Digest::HMAC.digest(key, block).getbyte(0)
+  i += 1
+end
+sum += sha.digest.getbyte(31)
+puts sum
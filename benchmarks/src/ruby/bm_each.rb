@@ -0,0 +1,11 @@
+# Nested block calls: each level is an each frame plus a block frame
+list = [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]
+sum = 0
+200.times do
+  list.each do |a|
+    list.each do |b|
+      list.each { |c| sum += a + b - c }
+    end
+  end
+end
+puts sum
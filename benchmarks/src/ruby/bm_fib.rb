@@ -0,0 +1,6 @@
+# Recursive calls: one frame push/pop per call, ~150k calls
+def fib(n)
+  n < 2 ? n : fib(n - 1) + fib(n - 2)
+end
+
+puts fib(24)
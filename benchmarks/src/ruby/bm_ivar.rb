@@ -0,0 +1,34 @@
+# Small objects: allocation with four ivars, then attribute reads/writes
+class Point
+  attr_reader :x, :y
+
+  def initialize(x, y)
+    @x = x
+    @y = y
+    @vx = 1
+    @vy = 2
+  end
+
+  def step
+    @x += @vx
+    @y += @vy
+  end
+end
+
+points = []
+i = 0
+while i < 200
+  points << Point.new(i, -i)
+  i += 1
+end
+
+sum = 0
+n = 0
+while n < 200
+  points.each do |pt|
+    pt.step
+    sum += pt.x - pt.y
+  end
+  n += 1
+end
+puts sum
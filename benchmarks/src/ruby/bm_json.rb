@@ -0,0 +1,45 @@
+# Parse and generate 1 KB and 4 KB documents, and stream the 4 KB one
+# through JSON::PullParser in 64-byte chunks
+def records(n)
+  list = []
+  i = 0
+  while i < n
+    list << { "id" => i, "name" => "sensor-#{i}", "temp" => 20.5 + i % 7,
+              "ok" => i % 3 != 0, "pins" => [i % 8, (i + 1) % 8] }
+    i += 1
+  end
+  list
+end
+
+small = JSON.generate(records(16))
+large = JSON.generate(records(64))
+
+sum = 0
+i = 0
+while i < 100
+  doc = JSON.parse(small)
+  sum += doc.size + JSON.generate(doc).size
+  i += 1
+end
+
+i = 0
+while i < 25
+  doc = JSON.parse(large, symbolize_names: true)
+  sum += doc[i][:id] + JSON.generate(doc).size
+  i += 1
+end
+
+i = 0
+while i < 25
+  parser = JSON::PullParser.new
+  pos = 0
+  while pos < large.size
+    parser << large[pos, 64]
+    pos += 64
+    while (event = parser.next)
+      sum += 1 if event == :key
+    end
+  end
+  i += 1
+end
+puts sum
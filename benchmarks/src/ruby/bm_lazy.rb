@@ -0,0 +1,22 @@
+# Lazy map/select/take chains over 10,000-element Range, packed and line sources
+readings = ""
+log = ""
+seed = 7
+n = 0
+while n < 10000
+  seed = (seed * 75 + 74) % 65537
+  readings << [seed].pack("n")
+  log << (seed % 7 == 0 ? "E " : "I ") + (seed % 1000).to_s + "\n" if n % 5 == 0
+  n += 1
+end
+
+sum = 0
+i = 0
+while i < 3
+  sum += (1..10000).lazy.map { |x| x * 3 }.select { |x| x % 7 == 1 }.sum
+  sum += (1..10000).lazy.map { |x| x * x }.select { |x| x % 10 == 6 }.first(50).size
+  sum += readings.lazy_unpack("n").map { |x| x >> 4 }.reject { |x| x < 1000 }.take(5000).sum
+  sum += log.lazy_lines.select { |l| l.start_with?("E") }.map { |l| l.size }.sum
+  i += 1
+end
+puts sum
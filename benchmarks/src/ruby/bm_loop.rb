@@ -0,0 +1,6 @@
+# Bare loop overhead: JMP/JMPIF, LOADI and ADDI per iteration
+i = 0
+while i < 1_000_000
+  i += 1
+end
+puts i
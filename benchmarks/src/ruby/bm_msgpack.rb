@@ -0,0 +1,25 @@
+# Pack and unpack a batch of 16 telemetry records 200 times with the
+# native MessagePack; bm_msgpack_ruby.rb does the same in plain Ruby
+def record(i)
+  { "id" => i, "device" => "node-#{i % 10}", "ts" => 1700000000 + i * 60,
+    "temp" => 20.5 + (i % 13) * 0.25, "rssi" => -40 - i % 50,
+    "ok" => i % 7 != 0, "readings" => [i % 100, (i * 3) % 1000, (i * 7) % 70000] }
+end
+
+batch = []
+i = 0
+while i < 16
+  batch << record(i)
+  i += 1
+end
+
+sum = 0
+i = 0
+while i < 200
+  data = MessagePack.pack(batch)
+  back = MessagePack.unpack(data)
+  sum += data.size + back[i % 16]["ts"] % 1000
+  sum += 1 if back == batch
+  i += 1
+end
+puts sum
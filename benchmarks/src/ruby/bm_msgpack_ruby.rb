@@ -0,0 +1,151 @@
+# The bm_msgpack.rb workload with MessagePack written in plain Ruby:
+# String concatenation to pack, getbyte and unpack1 to unpack
+def mp_header(out, fix, max, type16, n)
+  if n <= max
+    out << (fix | n).chr
+  else
+    out << [type16, n].pack("Cn")
+  end
+end
+
+def mp_pack(out, v)
+  if v.nil?
+    out << 0xc0.chr
+  elsif v == true
+    out << 0xc3.chr
+  elsif v == false
+    out << 0xc2.chr
+  elsif v.class == Integer
+    if v >= 0
+      if v < 0x80
+        out << v.chr
+      elsif v < 0x100
+        out << [0xcc, v].pack("CC")
+      elsif v < 0x10000
+        out << [0xcd, v].pack("Cn")
+      else
+        out << [0xce, v].pack("CN")
+      end
+    elsif v >= -32
+      out << (v + 256).chr
+    elsif v >= -128
+      out << [0xd0, v].pack("Cc")
+    elsif v >= -32768
+      out << [0xd1, v].pack("Cs>")
+    else
+      out << [0xd2, v].pack("Cl>")
+    end
+  elsif v.class == Float
+    out << [0xcb, v].pack("CG")
+  elsif v.class == String
+    if v.size < 32
+      out << (0xa0 | v.size).chr
+    elsif v.size < 0x100
+      out << [0xd9, v.size].pack("CC")
+    else
+      out << [0xda, v.size].pack("Cn")
+    end
+    out << v
+  elsif v.class == Array
+    mp_header(out, 0x90, 15, 0xdc, v.size)
+    v.each { |x| mp_pack(out, x) }
+  elsif v.class == Hash
+    mp_header(out, 0x80, 15, 0xde, v.size)
+    v.each do |k, x|
+      mp_pack(out, k)
+      mp_pack(out, x)
+    end
+  end
+  out
+end
+
+class MPReader
+  def initialize(data)
+    @data = data
+    @pos = 0
+  end
+
+  def take(n, template)
+    v = @data[@pos, n].unpack1(template)
+    @pos += n
+    v
+  end
+
+  def str(n)
+    s = @data[@pos, n]
+    @pos += n
+    s
+  end
+
+  def ary(n)
+    a = []
+    n.times { a << read }
+    a
+  end
+
+  def map(n)
+    h = {}
+    n.times do
+      k = read
+      h[k] = read
+    end
+    h
+  end
+
+  def read
+    b = @data.getbyte(@pos)
+    @pos += 1
+    if b < 0x80
+      b
+    elsif b >= 0xe0
+      b - 256
+    elsif b >= 0xa0 && b < 0xc0
+      str(b & 0x1f)
+    elsif b >= 0x90 && b < 0xa0
+      ary(b & 0x0f)
+    elsif b < 0x90
+      map(b & 0x0f)
+    else
+      case b
+      when 0xc0 then nil
+      when 0xc2 then false
+      when 0xc3 then true
+      when 0xcc then take(1, "C")
+      when 0xcd then take(2, "n")
+      when 0xce then take(4, "N")
+      when 0xd0 then take(1, "c")
+      when 0xd1 then take(2, "s>")
+      when 0xd2 then take(4, "l>")
+      when 0xcb then take(8, "G")
+      when 0xd9 then str(take(1, "C"))
+      when 0xda then str(take(2, "n"))
+      when 0xdc then ary(take(2, "n"))
+      when 0xde then map(take(2, "n"))
+      end
+    end
+  end
+end
+
+def record(i)
+  { "id" => i, "device" => "node-#{i % 10}", "ts" => 1700000000 + i * 60,
+    "temp" => 20.5 + (i % 13) * 0.25, "rssi" => -40 - i % 50,
+    "ok" => i % 7 != 0, "readings" => [i % 100, (i * 3) % 1000, (i * 7) % 70000] }
+end
+
+batch = []
+i = 0
+while i < 16
+  batch << record(i)
+  i += 1
+end
+
+sum = 0
+i = 0
+while i < 200
+  data = mp_pack("", batch)
+  back = MPReader.new(data).read
+  sum += data.size + back[i % 16]["ts"] % 1000
+  sum += 1 if back == batch
+  i += 1
+end
+puts sum
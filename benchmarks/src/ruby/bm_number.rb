@@ -0,0 +1,15 @@
+# 100,000 conversions: Integer#to_s, String#to_i, Float#to_s, String#to_f, format
+seed = 7
+sum = 0
+i = 0
+while i < 20000
+  seed = (seed * 75 + 74) % 65537
+  s = (seed * 1009 - 33000000).to_s
+  sum += s.to_i % 1000
+  f = seed / 100.0
+  t = f.to_s
+  sum += (t.to_f * 100).round % 1000
+  sum += format("%d,%.2f,%5s", seed, f, "ok").size
+  i += 1
+end
+puts sum
@@ -0,0 +1,16 @@
+# Match 2k "key = value" lines and split a CSV record per line
+lines = ["temp = 23", "# comment", "rate=115200", "name = sensor-1", "  gain =  7"]
+setting = Regexp.compile("^\\s*(\\w+)\\s*=\\s*(\\d+)$")
+comma = Regexp.compile(",\\s*")
+record = "12, 7,3, 40,1"
+
+sum = 0
+i = 0
+while i < 2000
+  if lines[i % 5] =~ setting
+    sum += $2.to_i + $1.size
+  end
+  record.split(comma).each { |f| sum += f.to_i }
+  i += 1
+end
+puts sum
@@ -0,0 +1,22 @@
+# raise/rescue round trips, as used for validation errors in parsers
+class ParseError < StandardError; end
+
+def check(v)
+  raise ParseError if v % 3 == 0
+  v
+end
+
+ok = 0
+failed = 0
+i = 0
+while i < 20000
+  begin
+    ok += check(i)
+  rescue ArgumentError
+    failed -= 1
+  rescue ParseError
+    failed += 1
+  end
+  i += 1
+end
+puts ok + failed
@@ -0,0 +1,22 @@
+# Search log text of 100 B, 1 KB, 8 KB and 64 KB, about 512 KB per size
+line = "t=1712 lvl=info mod=net status=ok rssi=-61\n"
+
+sum = 0
+[100, 1024, 8192, 65536].each do |size|
+  log = line * (size / line.size)
+  log << "status=fail\n"
+  reps = 524288 / log.size + 1
+  i = 0
+  while i < reps
+    sum += log.index("status=fail")
+    sum += log.index("!") ? 1 : 0
+    sum += 1 if log.include?("ERROR")
+    sum += 1 if log.end_with?("fail\n")
+    if size <= 8192
+      sum += log.split("\n").size
+      sum += log.gsub("=", ": ").size
+    end
+    i += 1
+  end
+end
+puts sum
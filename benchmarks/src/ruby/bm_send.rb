@@ -0,0 +1,28 @@
+# Method dispatch: SEND/ENTER/RETURN per call, including a block yield
+class Counter
+  def initialize
+    @n = 0
+  end
+
+  def inc(step)
+    @n += step
+  end
+
+  def n
+    @n
+  end
+
+  def twice
+    yield
+    yield
+  end
+end
+
+c = Counter.new
+i = 0
+while i < 100_000
+  c.inc(1)
+  c.twice { c.inc(2) }
+  i += 1
+end
+puts c.n
@@ -0,0 +1,23 @@
+# Sort 1,000 Integer, Float and String readings; sort_by, min_by, max_by
+seed = 7
+ints = []
+while ints.size < 1000
+  seed = (seed * 75 + 74) % 65537
+  ints << seed
+end
+floats = ints.map { |x| x / 8.0 }
+names = ints.map { |x| "node-" + x.to_s }
+records = ints.map { |x| [x % 97, x] }
+
+sum = 0
+i = 0
+while i < 10
+  sum += ints.sort[500]
+  sum += floats.sort[999].to_i
+  sum += names.sort[0].size
+  sum += records.sort_by { |r| r[1] % 1000 * 1000 + r[1] / 1000 }[0][1]
+  sum += records.min_by { |r| r[0] }[1]
+  sum += records.max_by { |r| r[0] }[1]
+  i += 1
+end
+puts sum
@@ -0,0 +1,16 @@
+# Decode 10k binary frames: sync, type, 16-bit sequence, 32-bit value, CRC
+frames = []
+i = 0
+while i < 8
+  frames << [0xAA, i, i * 300, i * 70000, 0x55].pack("CCnNC")
+  i += 1
+end
+
+sum = 0
+i = 0
+while i < 10000
+  sync, type, seq, value, crc = frames[i & 7].unpack("CCnNC")
+  sum += type + seq + (value & 0xffff) if sync == 0xAA && crc == 0x55
+  i += 1
+end
+puts sum
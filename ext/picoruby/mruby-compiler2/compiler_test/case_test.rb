@@ -58,4 +58,43 @@ class CaseTest < PicoRubyTest
     end
   RUBY
 
+  desc "case over many integer literals"
+  assert_equal(<<~RUBY, "[:a, :a, :b, :c, :d, :d, nil, :z, :a, :z]")
+    def f(x)
+      case x
+      when 1, 3 then :a
+      when 5 then :b
+      when -2 then :c
+      when 7, 9, 1 then :d
+      when 100
+      else :z
+      end
+    end
+    p [1, 3, 5, -2, 7, 9, 100, 4, 1.0, "x"].map { |v| f(v) }
+  RUBY
+
+  desc "case with integer literals wider than 31 bits"
+  assert_equal(<<~RUBY, "[:a, :b, :c, :a, :d, :d, nil]")
+    def w(x)
+      case x
+      when 1, 3_000_000_000 then :a
+      when 2 then :b
+      when -2147483648 then :c
+      when 4, 5 then :d
+      end
+    end
+    p [1, 2, -2147483648, 3_000_000_000, 4, 5.0, 6].map { |v| w(v) }
+  RUBY
+
+  desc "case over symbol literals"
+  assert_equal(<<~RUBY, "[1, 1, 2, nil, nil]")
+    def g(x)
+      case x
+      when :foo, :bar then 1
+      when :baz then 2
+      end
+    end
+    p [:foo, :bar, :baz, :q, "foo"].map { |v| g(v) }
+  RUBY
+
 end
@@ -15,4 +15,12 @@ class DstrTest < PicoRubyTest
     i = 100
     puts "_" + "#{i+1}a" + "b"
   RUBY
+
+  desc "interpolation of literals"
+  assert_equal(<<~'RUBY', "id=42 neg=-7 s=ok n= t=true x=5/5endlit\n12\nsym3")
+    x = 5
+    puts "id=#{42} neg=#{-7} s=#{:ok} n=#{nil}#{} t=#{true} x=#{x}/#{x}" "end#{"lit"}"
+    puts "#{1}#{2}"
+    puts :"sym#{3}"
+  RUBY
 end
@@ -0,0 +1,23 @@
+class FreezeTest < PicoRubyTest
+
+  desc "freeze on a string literal"
+  assert_equal(<<~RUBY, "str")
+    s = "str".freeze
+    puts s
+  RUBY
+
+  desc "freeze on a literal constant table"
+  assert_equal(<<~RUBY, '{a: 1, "b" => [2, nil]}')
+    TABLE = {a: 1, "b" => [2, nil]}.freeze
+    p TABLE
+  RUBY
+
+  desc "freeze on immutable literals"
+  assert_equal(<<~RUBY, "1\n2.5\n:sym\nnil\ntrue")
+    p 1.freeze
+    p 2.5.freeze
+    p :sym.freeze
+    p nil.freeze
+    p true.freeze
+  RUBY
+end
@@ -83,6 +83,38 @@ class PicoRubyTest
     GC.disable # To keep temporary files
     actual = `#{@@picoruby_path} -e '#{script}'`.chomp.gsub(/\r/, "")
     GC.enable
+    check(script, expected, actual)
+  end
+
+  # Every send's block slot, after its arguments, must be inside the frame
+  def self.assert_send_registers(script)
+    if @@pending || @@picorbc_path.nil?
+      print "#{@@brown}.#{@@reset}"
+      @@pending_count += 1
+      return
+    end
+    dump = Tempfile.create(["send_registers", ".rb"]) do |file|
+      file.write(script)
+      file.flush
+      `#{@@picorbc_path} -v -o #{File::NULL} #{file.path} 2>&1`
+    end
+    nregs = nil
+    overflows = []
+    dump.each_line do |line|
+      if line =~ /nregs=(\d+)/
+        nregs = $1.to_i
+      elsif line =~ /\bS?SENDB?\s+R(\d+)\s+:\S+\s+n=(\d+|\*)(?:\|nk=(\d+|\*))?/
+        a = $1.to_i
+        n = $2 == "*" ? 1 : $2.to_i
+        nk = $3.nil? ? 0 : ($3 == "*" ? 1 : $3.to_i * 2)
+        overflows << "nregs=#{nregs} #{line.strip}" if a + n + nk + 1 >= nregs
+      end
+    end
+    actual = nregs ? overflows.join("\n") : "no code dump from #{@@picorbc_path}"
+    check(script, "", actual)
+  end
+
+  def self.check(script, expected, actual)
     if actual == expected
       print "#{@@green}."
       @@success_count += 1
@@ -0,0 +1,64 @@
+class IteratorTest < PicoRubyTest
+
+  desc "times with next and break"
+  assert_equal(<<~RUBY, "[0, 2, 4]\n7")
+    a = []
+    r = 10.times do |i|
+      next if i.odd?
+      break 7 if i > 4
+      a << i
+    end
+    p a
+    p r
+  RUBY
+
+  desc "upto and step return the receiver"
+  assert_equal(<<~RUBY, "[1, 2, 3]\n1\n[10, 6, 2]\n10")
+    a = []
+    r = 1.upto(3) { |i| a << i }
+    p a
+    p r
+    b = []
+    r = 10.step(1, -4) { |i| b << i }
+    p b
+    p r
+  RUBY
+
+  desc "each over an array and a non-array receiver"
+  assert_equal(<<~RUBY, "6\n6")
+    s = 0
+    [1, 2, 3].each { |x| s += x }
+    p s
+    s = 0
+    (1..3).each { |x| s += x }
+    p s
+  RUBY
+
+  desc "block locals start as nil on each iteration"
+  assert_equal(<<~RUBY, "[1, 1]")
+    a = []
+    2.times do
+      t ||= 0
+      t += 1
+      a << t
+    end
+    p a
+  RUBY
+
+  desc "downto and each_with_index"
+  assert_equal(<<~'RUBY', "14\n0a\n1b\n7\n8")
+    s = 0
+    5.downto(2) { |i| s += i }
+    p s
+    %w(a b).each_with_index { |x, i| puts "#{i}#{x}" }
+    [7, 8].each_with_index { |x| p x }
+  RUBY
+
+  desc "inlined loops keep every send's block slot inside the frame"
+  assert_send_registers("[1, 2].each { |x| x }")
+  assert_send_registers("[1, 2].each_with_index { |x, i| }")
+  assert_send_registers("3.downto(1) { |i| i }")
+  assert_send_registers("1.upto(3) { |i| i }")
+  assert_send_registers("1.step(9, 2) { |i| i }")
+  assert_send_registers("2.times { }")
+end
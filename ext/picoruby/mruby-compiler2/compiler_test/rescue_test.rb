@@ -95,4 +95,23 @@ class RescueTest < PicoRubyTest
 
   end
 
+  desc "rescue clauses tried in order"
+  assert_equal(<<~RUBY, "1\n2\n3\n4")
+    def check(e)
+      begin
+        raise e
+      rescue ArgumentError
+        1
+      rescue TypeError, IndexError
+        e == TypeError ? 2 : 3
+      rescue
+        4
+      end
+    end
+    p check(ArgumentError)
+    p check(TypeError)
+    p check(IndexError)
+    p check(RuntimeError)
+  RUBY
+
 end
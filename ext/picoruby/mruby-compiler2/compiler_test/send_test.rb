@@ -0,0 +1,47 @@
+class SendTest < PicoRubyTest
+
+  desc "send with a literal name calls a Ruby method"
+  assert_equal(<<~RUBY, "3\n3\n3")
+    class Calc
+      def add(a, b)
+        a + b
+      end
+    end
+    c = Calc.new
+    p c.send(:add, 1, 2)
+    p c.__send__(:add, 1, 2)
+    p c.public_send(:add, 1, 2)
+  RUBY
+
+  desc "send with a literal name passes the block and splat"
+  assert_equal(<<~RUBY, "11\n[1, 2, 3]")
+    class Calc
+      def twice
+        yield 5
+      end
+      def list(*a)
+        a
+      end
+    end
+    c = Calc.new
+    p c.send(:twice) { |x| x * 2 + 1 }
+    args = [2, 3]
+    p c.send(:list, 1, *args)
+  RUBY
+
+  desc "send with a literal name and no receiver"
+  assert_equal(<<~RUBY, "hello, world")
+    def greet(name)
+      "hello, " + name
+    end
+    puts send(:greet, "world")
+  RUBY
+
+  desc "send with a literal name through safe navigation"
+  assert_equal(<<~RUBY, "nil\n\"1\"")
+    x = nil
+    p x&.send(:to_s)
+    x = 1
+    p x&.send(:to_s)
+  RUBY
+end
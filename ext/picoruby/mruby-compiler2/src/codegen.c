@@ -10,6 +10,10 @@
 #include "../include/mrc_dump.h"
 #include "../include/mrc_debug.h"
 
+#ifdef MRC_REGEXP_PRECOMPILE
+#include <hako_re.h>
+#endif
+
 #if defined(PICORB_VM_MRUBY)
 #include "../include/mrc_proc.h"
 #endif
@@ -211,6 +215,8 @@ typedef struct scope {
   struct scope *prev;
 
   mrc_constant_id_list *lv;
+  mrc_constant_id_list *ilv;    /* locals of a block being inlined */
+  uint16_t ilv_base;            /* register of ilv->ids[0] */
 
   uint16_t sp;
   uint32_t pc;
@@ -1043,6 +1049,11 @@ gen_move(mrc_codegen_scope *s, uint16_t dst, uint16_t src, int nopeep)
 static int
 lv_idx(mrc_codegen_scope *s, mrc_sym id)
 {
+  if (s->ilv) {
+    for (size_t n = 0; n < s->ilv->size; n++) {
+      if (s->ilv->ids[n] == id) return s->ilv_base + n;
+    }
+  }
   if (!s->lv) return 0;
   for (size_t n = 0; n < s->lv->size; n++) {
     if (s->lv->ids[n] == id) return n + 1;
@@ -6,4 +6,20 @@ class Object
     block._set_self(self_save)
     result
   end
+
+  # With MRC_DIRECT_SEND the compiler turns send and __send__ with a
+  # literal Symbol into a direct call, so mostly a name computed at run
+  # time gets here. A Ruby method runs through a method Proc made per call.
+  def send(name, *args, &block)
+    body = __method_body(name)
+    if body
+      body.call(*args, &block)
+    elsif body.nil?
+      __send_c(name, *args, &block)
+    else
+      method_missing(name.to_sym, *args, &block)
+    end
+  end
+  alias __send__ send
+  alias public_send send
 end
@@ -1,41 +1,95 @@
 #include <mrc_common.h>
 #include <mrubyc.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 
+static bool
+get_method_symid(mrbc_vm *vm, mrbc_value *name, mrbc_sym *sym_id)
+{
+  if (name->tt == MRBC_TT_SYMBOL) {
+    *sym_id = name->sym_id;
+  } else if (name->tt == MRBC_TT_STRING) {
+    *sym_id = mrbc_str_to_symid((const char *)name->string->data);
+  } else {
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "Method name must be a string or symbol");
+    return false;
+  }
+  return true;
+}
+
 /*
- * Restriction: Methods written in Ruby can not be called by send.
+ * __send_c(name, *args): call the C method `name` on v[0].
+ * Object#send comes here for C methods only. The VM releases the
+ * argument registers after a C method returns, so a Ruby method could
+ * not run in this register window; send runs those with Proc#call.
  */
 static void
 c_object_send(mrbc_vm *vm, mrbc_value *v, int argc)
 {
+  if (argc < 1) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "no method name given");
+    return;
+  }
+  mrbc_sym sym_id;
+  if (!get_method_symid(vm, &v[1], &sym_id)) return;
+
   mrbc_method method;
-  const char *method_name;
-  if (v[1].tt == MRBC_TT_SYMBOL) {
-    method_name = (const char *)mrbc_symid_to_str(v[1].sym_id);
-  } else if (v[1].tt == MRBC_TT_STRING) {
-    method_name = (const char *)GET_STRING_ARG(1);
-  } else {
-    mrbc_raise(vm, MRBC_CLASS(TypeError), "Method name must be a string or symbol");
+  if (mrbc_find_method(&method, find_class_by_object(&v[0]), sym_id) == 0) {
+    mrbc_raisef(vm, MRBC_CLASS(NoMethodError), "undefined method '%s'", mrbc_symid_to_str(sym_id));
     return;
   }
-  if (mrbc_find_method(&method, find_class_by_object(&v[0]), mrbc_str_to_symid(method_name)) == 0) {
-    mrbc_raisef(vm, MRBC_CLASS(NoMethodError), "undefined method '%s'", method_name);
+  if (!method.c_func) {
+    mrbc_raisef(vm, MRBC_CLASS(RuntimeError), "C function is not defined for method '%s'", mrbc_symid_to_str(sym_id));
     return;
   }
-  if( !method.c_func ) {
-    mrbc_raisef(vm, MRBC_CLASS(RuntimeError), "C function is not defined for method '%s'", method_name);
+
+  // Drop the name and slide the arguments and the block slot down by one
+  // register. The VM then releases each of them once, as for a direct call.
+  mrbc_decref(&v[1]);
+  memmove(&v[1], &v[2], sizeof(mrbc_value) * argc);
+  v[argc + 1].tt = MRBC_TT_EMPTY;
+  method.func(vm, v, argc - 1);
+}
+
+/*
+ * __method_body(name) -> Proc, nil or false
+ * A Ruby method comes back as a method Proc whose self is the receiver,
+ * the same way instance_eval rebinds a block. Proc#call is the one C
+ * method that the VM lets keep its register window, so Object#send runs
+ * the body with it. A C method gives nil, and an undefined name gives
+ * false when there is a method_missing to take it.
+ */
+static void
+c_object_method_body(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  if (argc != 1) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
     return;
   }
+  mrbc_sym sym_id;
+  if (!get_method_symid(vm, &v[1], &sym_id)) return;
 
-  mrbc_value send_v[argc];
-  send_v[0] = v[0];
-  for (int i = 1; i < argc; i++) {
-    send_v[i] = v[i + 1];
+  mrbc_method method;
+  mrbc_class *cls = find_class_by_object(&v[0]);
+  if (mrbc_find_method(&method, cls, sym_id) == 0) {
+    if (mrbc_find_method(&method, cls, mrbc_str_to_symid("method_missing")) == 0) {
+      mrbc_raisef(vm, MRBC_CLASS(NoMethodError), "undefined method '%s'", mrbc_symid_to_str(sym_id));
+      return;
+    }
+    SET_FALSE_RETURN();
+    return;
+  }
+  if (method.c_func) {
+    SET_NIL_RETURN();
+    return;
   }
 
-  method.func(vm, send_v, argc - 1);
-  SET_RETURN(send_v[0]);
+  mrbc_value body = mrbc_proc_new(vm, method.irep, 'M');
+  if (!body.proc) return; // ENOMEM
+  mrbc_incref(&v[0]);
+  body.proc->self = v[0];
+  SET_RETURN(body);
 }
 
 static void
@@ -411,6 +465,53 @@ c_alias_method(mrbc_vm *vm, mrbc_value *v, int argc)
   SET_RETURN(return_sym);
 }
 
+/*
+ * define_method(name) { ... } / define_method(name, proc)
+ * The block body becomes the method body. Like any mruby/c block it
+ * reaches outer locals through the call chain, so it must not refer to
+ * local variables of the scope that defined it.
+ */
+static void
+c_define_method(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+  if (argc != 1 && argc != 2) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+    return;
+  }
+  mrbc_sym sym_id;
+  if (!get_method_symid(vm, &v[1], &sym_id)) return;
+
+  // An explicit proc argument, otherwise the block
+  mrbc_value *body = &v[2];
+  if (body->tt != MRBC_TT_PROC) {
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "tried to create Proc object without a block");
+    return;
+  }
+
+  mrbc_class *cls;
+  if (v[0].tt == MRBC_TT_CLASS || v[0].tt == MRBC_TT_MODULE) {
+    cls = v[0].cls;
+  } else {
+    cls = vm->target_class;
+  }
+
+  mrbc_method *method = (vm->vm_id == 0) ?
+    mrbc_raw_alloc_no_free(sizeof(mrbc_method)) :
+    mrbc_raw_alloc(sizeof(mrbc_method));
+  if (!method) return; // ENOMEM
+
+  method->type = (vm->vm_id == 0) ? 'm' : 'M';
+  method->c_func = 0;
+  method->sym_id = sym_id;
+  method->irep = body->proc->irep;
+
+  // Takes a reference on the irep, so it outlives the block and its task
+  sub_def_alias(cls, method, sym_id);
+
+  mrbc_value return_sym = mrbc_symbol_value(sym_id);
+  SET_RETURN(return_sym);
+}
+
 #define MAX_CALLINFO 100
 
 static void
@@ -494,7 +595,8 @@ c_rbconfig_ruby(mrbc_vm *vm, mrbc_value *v, int argc)
 void
 mrbc_metaprog_init(mrbc_vm *vm)
 {
-  mrbc_define_method(vm, mrbc_class_object, "send", c_object_send);
+  mrbc_define_method(vm, mrbc_class_object, "__send_c", c_object_send);
+  mrbc_define_method(vm, mrbc_class_object, "__method_body", c_object_method_body);
   mrbc_define_method(vm, mrbc_class_object, "methods", c_object_methods);
   mrbc_define_method(vm, mrbc_class_object, "__id__", c_object_id);
 #if !defined(MRBC_DEBUG)
@@ -513,6 +615,7 @@ mrbc_metaprog_init(mrbc_vm *vm)
   mrbc_define_method(vm, mrbc_class_object, "_set_self", c_proc__set_self);
 
   mrbc_define_method(vm, mrbc_class_object, "alias_method", c_alias_method);
+  mrbc_define_method(vm, mrbc_class_object, "define_method", c_define_method);
 
   mrbc_class *module_Kernel = mrbc_get_class_by_name("Kernel");
   mrbc_define_method(vm, module_Kernel, "caller", c_kernel_caller);
@@ -4,6 +4,24 @@ class TestAliasClass
   end
 end
 
+class TestSendClass
+  def add(a, b)
+    a + b
+  end
+
+  def with_block
+    yield 10
+  end
+
+  def method_missing(name, *args)
+    [name, args]
+  end
+end
+
+class TestDefineMethodClass
+  define_method(:double) { |x| x * 2 }
+end
+
 class MetaprogTest < Picotest::Test
   def test_alias_method
     TestAliasClass.alias_method(:aliased, :original)
@@ -11,4 +29,42 @@ class MetaprogTest < Picotest::Test
     assert_equal(42, obj.original)
     assert_equal(42, obj.aliased)
   end
+
+  def test_send_ruby_method
+    obj = TestSendClass.new
+    assert_equal(3, obj.send(:add, 1, 2))
+    assert_equal(3, obj.send("add", 1, 2))
+    assert_equal(3, obj.public_send(:add, 1, 2))
+  end
+
+  def test_send_computed_name
+    obj = TestSendClass.new
+    name = "ad" + "d"
+    assert_equal(3, obj.send(name, 1, 2))
+    assert_equal(3, obj.send(name.to_sym, 1, 2))
+    assert_equal(11, obj.send("with_block") { |x| x + 1 })
+  end
+
+  def test_send_c_method
+    assert_equal(3, [1, 2, 3].send(:size))
+    assert_equal("1", 1.send(:to_s))
+    assert_equal(3, [1, 2, 3].send("size"))
+  end
+
+  def test_send_with_block
+    obj = TestSendClass.new
+    assert_equal(11, obj.send(:with_block) { |x| x + 1 })
+  end
+
+  def test_send_method_missing
+    obj = TestSendClass.new
+    name = :unknown
+    assert_equal([:unknown, [1, 2]], obj.send(name, 1, 2))
+  end
+
+  def test_define_method
+    obj = TestDefineMethodClass.new
+    assert_equal(42, obj.double(21))
+    assert_equal(42, obj.send(:double, 21))
+  end
 end
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file array_sort_ext.h
+ * @brief Array sort extension public API
+ */
+
+#ifndef ARRAY_SORT_EXT_H
+#define ARRAY_SORT_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the Array sort extension
+ *
+ * Replaces Array#sort and sort!, adds the key sorts used by sort_by,
+ * min_by and max_by, and queues lib/array_sort.rb to run before the
+ * application. Called automatically by HAKO loader during
+ * initialization.
+ */
+void mrbc_array_sort_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ARRAY_SORT_EXT_H */
@@ -0,0 +1,18 @@
+# SPDX-License-Identifier: Apache-2.0
+# Array#sort_by, min_by and max_by for the Array sort extension
+
+class Array
+  # The block runs once per element; the keys are compared in C
+
+  def sort_by(&block)
+    __sort_by(map(&block))
+  end
+
+  def min_by(&block)
+    __min_by(map(&block))
+  end
+
+  def max_by(&block)
+    __max_by(map(&block))
+  end
+end
@@ -0,0 +1,382 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file array_sort.c
+ * @brief Array#sort and sort! by introsort, and the key sorts behind
+ *        sort_by, min_by and max_by
+ *
+ * One pass over the elements picks the comparison: Integer, Float and
+ * String arrays compare their values directly, anything else goes
+ * through mrbc_compare(). The choice is fixed for the whole sort, so
+ * the switch in less() is always predicted.
+ *
+ * sort_by, min_by and max_by are defined in lib/array_sort.rb: the
+ * block runs once per element through map, and the keys come here.
+ */
+
+#include <hako/extension.h>
+#include <hako/loader.h>
+#include <hako/method.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <string.h>
+
+#include "array_sort_ext.h"
+
+#ifdef HAKO_ARRAY_SORT_RUBY
+#include "array_sort_registry.h"
+#endif
+
+LOG_MODULE_REGISTER(hako_array_sort, CONFIG_HAKO_LOG_LEVEL);
+
+/* Ranges this short are finished by insertion sort */
+#define INSERTION_MAX 16
+
+enum sort_kind {
+    SORT_INTEGER,
+    SORT_FLOAT,
+    SORT_STRING,
+    SORT_GENERIC,
+};
+
+/*
+ * Elements are `stride` values apart and compared by the first one:
+ * stride 1 sorts an Array's own values, stride 2 sorts (key, element)
+ * pairs for sort_by.
+ */
+struct sorter {
+    mrbc_value *a;
+    int stride;
+    enum sort_kind kind;
+};
+
+static mrbc_func_t orig_sort;
+static mrbc_func_t orig_sort_bang;
+
+/* The comparison that fits every one of n values, stride apart */
+static enum sort_kind classify(const mrbc_value *a, int n, int stride)
+{
+    if (n == 0) {
+        return SORT_GENERIC;
+    }
+
+    int tt = a[0].tt;
+    if (tt != MRBC_TT_INTEGER && tt != MRBC_TT_STRING
+#if MRBC_USE_FLOAT
+        && tt != MRBC_TT_FLOAT
+#endif
+        ) {
+        return SORT_GENERIC;
+    }
+    for (int i = 1; i < n; i++) {
+        if (a[i * stride].tt != tt) {
+            return SORT_GENERIC;
+        }
+    }
+
+    switch (tt) {
+    case MRBC_TT_INTEGER:
+        return SORT_INTEGER;
+    case MRBC_TT_STRING:
+        return SORT_STRING;
+    default:
+        return SORT_FLOAT;
+    }
+}
+
+static int compare_strings(const mrbc_value *x, const mrbc_value *y)
+{
+    int xn = x->string->size;
+    int yn = y->string->size;
+    int c = memcmp(x->string->data, y->string->data, (xn < yn) ? xn : yn);
+
+    return c ? c : xn - yn;
+}
+
+/* Is x ordered before y? */
+static inline int less_value(enum sort_kind kind, const mrbc_value *x, const mrbc_value *y)
+{
+    switch (kind) {
+    case SORT_INTEGER:
+        return x->i < y->i;
+#if MRBC_USE_FLOAT
+    case SORT_FLOAT:
+        return x->d < y->d;
+#endif
+    case SORT_STRING:
+        return compare_strings(x, y) < 0;
+    default:
+        return mrbc_compare(x, y) < 0;
+    }
+}
+
+static inline int less(const struct sorter *s, int i, int j)
+{
+    return less_value(s->kind, &s->a[i * s->stride], &s->a[j * s->stride]);
+}
+
+static inline void swap(const struct sorter *s, int i, int j)
+{
+    mrbc_value *x = &s->a[i * s->stride];
+    mrbc_value *y = &s->a[j * s->stride];
+
+    for (int k = 0; k < s->stride; k++) {
+        mrbc_value t = x[k];
+        x[k] = y[k];
+        y[k] = t;
+    }
+}
+
+static void insertion_sort(const struct sorter *s, int lo, int hi)
+{
+    for (int i = lo + 1; i < hi; i++) {
+        for (int j = i; j > lo && less(s, j, j - 1); j--) {
+            swap(s, j, j - 1);
+        }
+    }
+}
+
+static void sift_down(const struct sorter *s, int lo, int root, int n)
+{
+    for (;;) {
+        int child = 2 * root + 1;
+        if (child >= n) {
+            return;
+        }
+        if (child + 1 < n && less(s, lo + child, lo + child + 1)) {
+            child++;
+        }
+        if (!less(s, lo + root, lo + child)) {
+            return;
+        }
+        swap(s, lo + root, lo + child);
+        root = child;
+    }
+}
+
+static void heap_sort(const struct sorter *s, int lo, int hi)
+{
+    int n = hi - lo;
+
+    for (int i = n / 2 - 1; i >= 0; i--) {
+        sift_down(s, lo, i, n);
+    }
+    for (int i = n - 1; i > 0; i--) {
+        swap(s, lo, lo + i);
+        sift_down(s, lo, 0, i);
+    }
+}
+
+/* Sort [lo, hi): quicksort, heapsort once depth runs out */
+static void intro_sort(const struct sorter *s, int lo, int hi, int depth)
+{
+    while (hi - lo > INSERTION_MAX) {
+        if (depth-- == 0) {
+            heap_sort(s, lo, hi);
+            return;
+        }
+
+        /* median of three, moved to lo as the pivot */
+        int mid = lo + (hi - lo) / 2;
+        if (less(s, mid, lo)) {
+            swap(s, mid, lo);
+        }
+        if (less(s, hi - 1, mid)) {
+            swap(s, hi - 1, mid);
+            if (less(s, mid, lo)) {
+                swap(s, mid, lo);
+            }
+        }
+        swap(s, lo, mid);
+
+        /* the bounds checks keep an inconsistent order (NaN) in range */
+        int i = lo;
+        int j = hi;
+        for (;;) {
+            do {
+                i++;
+            } while (i < hi && less(s, i, lo));
+            do {
+                j--;
+            } while (j > lo && less(s, lo, j));
+            if (i >= j) {
+                break;
+            }
+            swap(s, i, j);
+        }
+        swap(s, lo, j);
+
+        /* recurse into the smaller side */
+        if (j - lo < hi - j - 1) {
+            intro_sort(s, lo, j, depth);
+            lo = j + 1;
+        } else {
+            intro_sort(s, j + 1, hi, depth);
+            hi = j;
+        }
+    }
+    insertion_sort(s, lo, hi);
+}
+
+static void sort_values(mrbc_value *a, int n, int stride)
+{
+    struct sorter s = { a, stride, classify(a, n, stride) };
+    int depth = 0;
+
+    for (int m = n; m > 1; m >>= 1) {
+        depth += 2;
+    }
+    intro_sort(&s, 0, n, depth);
+}
+
+/*
+ * sort, sort!
+ */
+
+static int has_block(mrbc_value *v, int argc)
+{
+    return v[argc + 1].tt == MRBC_TT_PROC;
+}
+
+/* A block compares in Ruby; leave it to the method this one replaced */
+static void c_array_sort_bang(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc > 0 || has_block(v, argc)) {
+        hako_call_original(vm, v, argc, orig_sort_bang,
+                           MRBC_CLASS(ArgumentError), "sort with a block is not supported");
+        return;
+    }
+    sort_values(v[0].array->data, v[0].array->n_stored, 1);
+}
+
+static void c_array_sort(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc > 0 || has_block(v, argc)) {
+        hako_call_original(vm, v, argc, orig_sort,
+                           MRBC_CLASS(ArgumentError), "sort with a block is not supported");
+        return;
+    }
+
+    mrbc_value ret = mrbc_array_dup(vm, &v[0]);
+    if (ret.tt != MRBC_TT_ARRAY) {
+        return;
+    }
+    sort_values(ret.array->data, ret.array->n_stored, 1);
+    SET_RETURN(ret);
+}
+
+/*
+ * __sort_by, __min_by, __max_by: the keys from the block, one per element
+ */
+
+static int check_keys(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_ARRAY ||
+        v[1].array->n_stored != v[0].array->n_stored) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "one key per element expected");
+        return -1;
+    }
+    return 0;
+}
+
+static void c_array_sort_by_keys(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (check_keys(vm, v, argc) < 0) {
+        return;
+    }
+
+    int n = v[0].array->n_stored;
+    mrbc_value ret = mrbc_array_new(vm, n);
+    if (n == 0) {
+        SET_RETURN(ret);
+        return;
+    }
+
+    /* (key, element) pairs; the values are borrowed from the two Arrays */
+    mrbc_value *pairs = mrbc_raw_alloc(sizeof(mrbc_value) * 2 * n);
+    if (!pairs) {
+        mrbc_decref(&ret);
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        pairs[2 * i] = v[1].array->data[i];
+        pairs[2 * i + 1] = v[0].array->data[i];
+    }
+
+    sort_values(pairs, n, 2);
+
+    for (int i = 0; i < n; i++) {
+        mrbc_incref(&pairs[2 * i + 1]);
+        mrbc_array_push(&ret, &pairs[2 * i + 1]);
+    }
+    mrbc_raw_free(pairs);
+    SET_RETURN(ret);
+}
+
+/* The element with the smallest key, or the largest if max */
+static void array_extreme_by(mrbc_vm *vm, mrbc_value *v, int argc, int max)
+{
+    if (check_keys(vm, v, argc) < 0) {
+        return;
+    }
+
+    int n = v[0].array->n_stored;
+    if (n == 0) {
+        SET_NIL_RETURN();
+        return;
+    }
+
+    const mrbc_value *keys = v[1].array->data;
+    enum sort_kind kind = classify(keys, n, 1);
+    int best = 0;
+    for (int i = 1; i < n; i++) {
+        if (max ? less_value(kind, &keys[best], &keys[i])
+                : less_value(kind, &keys[i], &keys[best])) {
+            best = i;
+        }
+    }
+
+    mrbc_value ret = v[0].array->data[best];
+    mrbc_incref(&ret);
+    SET_RETURN(ret);
+}
+
+static void c_array_min_by_keys(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    array_extreme_by(vm, v, argc, 0);
+}
+
+static void c_array_max_by_keys(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    array_extreme_by(vm, v, argc, 1);
+}
+
+/**
+ * Initialize the Array sort extension
+ */
+void mrbc_array_sort_init(void)
+{
+    orig_sort = hako_find_c_method(MRBC_CLASS(Array), "sort");
+    orig_sort_bang = hako_find_c_method(MRBC_CLASS(Array), "sort!");
+
+    mrbc_define_method(0, MRBC_CLASS(Array), "sort", c_array_sort);
+    mrbc_define_method(0, MRBC_CLASS(Array), "sort!", c_array_sort_bang);
+    mrbc_define_method(0, MRBC_CLASS(Array), "__sort_by", c_array_sort_by_keys);
+    mrbc_define_method(0, MRBC_CLASS(Array), "__min_by", c_array_min_by_keys);
+    mrbc_define_method(0, MRBC_CLASS(Array), "__max_by", c_array_max_by_keys);
+
+#ifdef HAKO_ARRAY_SORT_RUBY
+    /* defines sort_by, min_by and max_by; runs before the application */
+    if (hako_load_library("array_sort", hako_array_sort_registry[0].bytecode) < 0) {
+        LOG_ERR("Failed to load array_sort.rb");
+    }
+#else
+    LOG_WRN("array_sort.rb not compiled; sort_by, min_by and max_by missing");
+#endif
+
+    LOG_DBG("Array sort registered");
+}
+
+HAKO_EXTENSION_DEFINE(array_sort, mrbc_array_sort_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file clock_ext.h
+ * @brief Clock extension public API
+ */
+
+#ifndef CLOCK_EXT_H
+#define CLOCK_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the clock extension
+ *
+ * Defines Process.clock_gettime, VM.cycles and the timing methods of
+ * Benchmark, and queues lib/benchmark.rb to run before the
+ * application. Called automatically by HAKO loader during
+ * initialization.
+ */
+void mrbc_clock_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CLOCK_EXT_H */
@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file clock.c
+ * @brief Process.clock_gettime, VM.cycles and the timing behind
+ *        Benchmark.measure
+ *
+ * The monotonic clock is the hardware cycle counter when the timer has
+ * a 64-bit one, and the kernel tick count otherwise. Values too large
+ * for an Integer (a nanosecond count passes 2^31 after about two
+ * seconds when mrbc_int_t is 32 bits) are returned as Floats, which
+ * hold them exactly for over 100 days.
+ *
+ * Benchmark.measure and realtime are defined in lib/benchmark.rb: the
+ * block runs there between __start and __stop, and __stop takes off
+ * the cost of an empty measurement, calibrated when the file loads.
+ */
+
+#include <hako/extension.h>
+#include <hako/loader.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "clock_ext.h"
+
+#ifdef HAKO_CLOCK_RUBY
+#include "clock_registry.h"
+#endif
+
+LOG_MODULE_REGISTER(hako_clock, CONFIG_HAKO_LOG_LEVEL);
+
+extern struct RBuiltinClass mrbc_class_VM;
+
+/* Process::CLOCK_MONOTONIC, as on Linux */
+#define CLOCK_ID_MONOTONIC 1
+
+/* Units of clock_gettime; float_second is the default */
+static struct clock_unit {
+    const char *name;
+    uint32_t ns;        /* nanoseconds per unit */
+    uint8_t is_float;
+    mrbc_sym sym;
+} clock_units[] = {
+    { "float_second", 1000000000, 1 },
+    { "float_millisecond", 1000000, 1 },
+    { "float_microsecond", 1000, 1 },
+    { "second", 1000000000, 0 },
+    { "millisecond", 1000000, 0 },
+    { "microsecond", 1000, 0 },
+    { "nanosecond", 1, 0 },
+};
+
+static mrbc_sym sym_monotonic;
+
+/* Cost of an empty Benchmark.measure, in nanoseconds */
+static uint64_t measure_overhead;
+
+static uint64_t monotonic_ns(void)
+{
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+    return k_cyc_to_ns_floor64(k_cycle_get_64());
+#else
+    return k_ticks_to_ns_floor64(k_uptime_ticks());
+#endif
+}
+
+/* An Integer if x fits in one, a Float otherwise */
+static mrbc_value u64_value(mrbc_vm *vm, uint64_t x)
+{
+    mrbc_int_t i = (mrbc_int_t)x;
+
+    if (i >= 0 && (uint64_t)i == x) {
+        return mrbc_integer_value(i);
+    }
+#if MRBC_USE_FLOAT
+    return mrbc_float_value(vm, (double)x);
+#else
+    return mrbc_integer_value(i);
+#endif
+}
+
+/* The reverse of u64_value(), for a stamp handed back by Ruby */
+static int value_u64(const mrbc_value *v, uint64_t *x)
+{
+    if (v->tt == MRBC_TT_INTEGER && v->i >= 0) {
+        *x = v->i;
+        return 0;
+    }
+#if MRBC_USE_FLOAT
+    if (v->tt == MRBC_TT_FLOAT && v->d >= 0) {
+        *x = (uint64_t)v->d;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+/*
+ * Process
+ */
+
+/* Process.clock_gettime(clock_id = :monotonic, unit = :float_second) */
+static void c_process_clock_gettime(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc >= 1 &&
+        !(v[1].tt == MRBC_TT_SYMBOL && v[1].sym_id == sym_monotonic) &&
+        !(v[1].tt == MRBC_TT_INTEGER && v[1].i == CLOCK_ID_MONOTONIC)) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "only the monotonic clock is available");
+        return;
+    }
+
+    const struct clock_unit *unit = &clock_units[0];
+    if (argc >= 2) {
+        unit = NULL;
+        for (int i = 0; i < ARRAY_SIZE(clock_units); i++) {
+            if (v[2].tt == MRBC_TT_SYMBOL && v[2].sym_id == clock_units[i].sym) {
+                unit = &clock_units[i];
+                break;
+            }
+        }
+        if (!unit) {
+            mrbc_raise(vm, MRBC_CLASS(ArgumentError), "unexpected unit");
+            return;
+        }
+    }
+
+    uint64_t ns = monotonic_ns();
+    if (unit->is_float) {
+#if MRBC_USE_FLOAT
+        SET_RETURN(mrbc_float_value(vm, (double)ns / unit->ns));
+#else
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "Float units need MRBC_USE_FLOAT");
+#endif
+        return;
+    }
+    SET_RETURN(u64_value(vm, ns / unit->ns));
+}
+
+/*
+ * VM
+ */
+
+/* VM.cycles: the hardware cycle counter */
+static void c_vm_cycles(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+#ifdef CONFIG_TIMER_HAS_64BIT_CYCLE_COUNTER
+    SET_RETURN(u64_value(vm, k_cycle_get_64()));
+#else
+    SET_RETURN(u64_value(vm, k_cycle_get_32()));
+#endif
+}
+
+static void c_vm_cycles_per_second(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    SET_RETURN(u64_value(vm, sys_clock_hw_cycles_per_sec()));
+}
+
+/*
+ * Benchmark
+ */
+
+static void c_benchmark_start(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    SET_RETURN(u64_value(vm, monotonic_ns()));
+}
+
+static int elapsed_ns(mrbc_vm *vm, mrbc_value *v, int argc, uint64_t *ns)
+{
+    uint64_t now = monotonic_ns();
+    uint64_t start;
+
+    if (argc < 1 || value_u64(&v[1], &start) < 0) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "start stamp expected");
+        return -1;
+    }
+    *ns = (now > start) ? now - start : 0;
+    return 0;
+}
+
+/* Nanoseconds since the stamp from __start */
+static void c_benchmark_elapsed(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint64_t ns;
+
+    if (elapsed_ns(vm, v, argc, &ns) == 0) {
+        SET_RETURN(u64_value(vm, ns));
+    }
+}
+
+/* As __elapsed, less the cost of measuring */
+static void c_benchmark_stop(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint64_t ns;
+
+    if (elapsed_ns(vm, v, argc, &ns) == 0) {
+        SET_RETURN(u64_value(vm, (ns > measure_overhead) ? ns - measure_overhead : 0));
+    }
+}
+
+static void c_benchmark_overhead(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    SET_RETURN(u64_value(vm, measure_overhead));
+}
+
+static void c_benchmark_set_overhead(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint64_t ns;
+
+    if (argc < 1 || value_u64(&v[1], &ns) < 0) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "overhead must not be negative");
+        return;
+    }
+    measure_overhead = ns;
+    SET_RETURN(v[1]);
+}
+
+/**
+ * Initialize the clock extension
+ */
+void mrbc_clock_init(void)
+{
+    sym_monotonic = mrbc_str_to_symid("monotonic");
+    for (int i = 0; i < ARRAY_SIZE(clock_units); i++) {
+        clock_units[i].sym = mrbc_str_to_symid(clock_units[i].name);
+    }
+
+    mrbc_class *process = mrbc_define_module(0, "Process");
+    mrbc_value id = mrbc_integer_value(CLOCK_ID_MONOTONIC);
+    mrbc_set_class_const(process, mrbc_str_to_symid("CLOCK_MONOTONIC"), &id);
+    mrbc_define_method(0, process, "clock_gettime", c_process_clock_gettime);
+
+    mrbc_define_method(0, MRBC_CLASS(VM), "cycles", c_vm_cycles);
+    mrbc_define_method(0, MRBC_CLASS(VM), "cycles_per_second", c_vm_cycles_per_second);
+
+    mrbc_class *benchmark = mrbc_define_module(0, "Benchmark");
+    mrbc_define_method(0, benchmark, "__start", c_benchmark_start);
+    mrbc_define_method(0, benchmark, "__elapsed", c_benchmark_elapsed);
+    mrbc_define_method(0, benchmark, "__stop", c_benchmark_stop);
+    mrbc_define_method(0, benchmark, "overhead", c_benchmark_overhead);
+    mrbc_define_method(0, benchmark, "overhead=", c_benchmark_set_overhead);
+
+#ifdef HAKO_CLOCK_RUBY
+    /* defines Benchmark.measure and realtime and calibrates the overhead */
+    if (hako_load_library("clock", hako_clock_registry[0].bytecode) < 0) {
+        LOG_ERR("Failed to load benchmark.rb");
+    }
+#else
+    LOG_WRN("benchmark.rb not compiled; Benchmark.measure missing");
+#endif
+
+    LOG_DBG("Clock registered");
+}
+
+HAKO_EXTENSION_DEFINE(clock, mrbc_clock_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
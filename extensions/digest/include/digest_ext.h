@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file digest_ext.h
+ * @brief Digest extension public API
+ */
+
+#ifndef DIGEST_EXT_H
+#define DIGEST_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the Digest extension
+ *
+ * Registers Digest::CRC16, Digest::CRC16CCITT, Digest::CRC32,
+ * Digest::SHA256 and Digest::HMAC with the mruby/c VM. Called
+ * automatically by HAKO loader during initialization.
+ */
+void mrbc_digest_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DIGEST_EXT_H */
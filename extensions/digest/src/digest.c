@@ -0,0 +1,605 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file digest.c
+ * @brief Digest::CRC16, CRC16CCITT, CRC32, SHA256 and HMAC
+ *
+ * The CRCs come from Zephyr's sys/crc.h and SHA-256 from PSA crypto.
+ * Every class hashes incrementally through update / <<, and its class
+ * methods (checksum, digest, hexdigest) hash one String in a single
+ * call. Input is a String or an Array of byte Integers.
+ *
+ * HMAC is built on the PSA hash rather than psa_mac_*(), so no key has
+ * to be imported into the PSA key store.
+ */
+
+#include <hako/extension.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#ifdef CONFIG_FILE_SYSTEM
+#include <zephyr/fs/fs.h>
+#endif
+#include <psa/crypto.h>
+
+#include <string.h>
+
+#include "digest_ext.h"
+
+LOG_MODULE_REGISTER(hako_digest, CONFIG_HAKO_LOG_LEVEL);
+
+#define SHA256_SIZE 32
+#define SHA256_BLOCK_SIZE 64
+
+/* Bytes of an Array handed to the hash at a time */
+#define ARRAY_CHUNK 64
+
+enum crc_kind {
+    CRC16,          /* CRC-16/ARC: reflected 0x8005, init 0 */
+    CRC16_CCITT,    /* CRC-16/CCITT-FALSE: 0x1021, init 0xffff */
+    CRC32,          /* CRC-32/ISO-HDLC, as zlib */
+    CRC_KINDS,
+};
+
+static const uint32_t crc_init[CRC_KINDS] = { 0, 0xffff, 0 };
+static const uint8_t crc_size[CRC_KINDS] = { 2, 2, 4 };
+
+struct digest_crc {
+    uint32_t crc;
+    uint8_t kind;
+};
+
+struct digest_sha256 {
+    psa_hash_operation_t op;
+};
+
+struct digest_hmac {
+    psa_hash_operation_t inner;
+    uint8_t opad[SHA256_BLOCK_SIZE];    /* key ^ 0x5c, for the outer hash */
+};
+
+static mrbc_class *crc_class[CRC_KINDS];
+static mrbc_class *sha256_class;
+static mrbc_class *hmac_class;
+
+typedef void (*update_fn)(void *ctx, const uint8_t *data, size_t len);
+
+/*
+ * Input
+ */
+
+/* Pass a String, or an Array of bytes in chunks, to fn */
+static int feed(mrbc_vm *vm, const mrbc_value *data, update_fn fn, void *ctx)
+{
+    if (data->tt == MRBC_TT_STRING) {
+        fn(ctx, data->string->data, data->string->size);
+        return 0;
+    }
+    if (data->tt != MRBC_TT_ARRAY) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return -1;
+    }
+
+    /* check first, so a bad element leaves the digest untouched */
+    int n = data->array->n_stored;
+    for (int i = 0; i < n; i++) {
+        if (data->array->data[i].tt != MRBC_TT_INTEGER) {
+            mrbc_raise(vm, MRBC_CLASS(TypeError), "byte Array must hold Integers");
+            return -1;
+        }
+    }
+
+    uint8_t chunk[ARRAY_CHUNK];
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+        chunk[len++] = (uint8_t)mrbc_integer(data->array->data[i]);
+        if (len == sizeof(chunk)) {
+            fn(ctx, chunk, len);
+            len = 0;
+        }
+    }
+    if (len > 0) {
+        fn(ctx, chunk, len);
+    }
+    return 0;
+}
+
+/* The argument of a one-shot class method, raising if it is missing */
+static mrbc_value *one_shot_arg(mrbc_vm *vm, mrbc_value *v, int argc, int n)
+{
+    if (argc < n) {
+        mrbc_raisef(vm, MRBC_CLASS(ArgumentError),
+                    "wrong number of arguments (given %d, expected %d)", argc, n);
+        return NULL;
+    }
+    return &v[n];
+}
+
+static mrbc_value hex_string(mrbc_vm *vm, const uint8_t *d, int n)
+{
+    static const char digits[] = "0123456789abcdef";
+    mrbc_value s = mrbc_string_new(vm, NULL, n * 2);
+
+    if (s.tt != MRBC_TT_STRING || !s.string) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return mrbc_nil_value();
+    }
+    for (int i = 0; i < n; i++) {
+        s.string->data[i * 2] = digits[d[i] >> 4];
+        s.string->data[i * 2 + 1] = digits[d[i] & 0x0f];
+    }
+    s.string->data[n * 2] = '\0';
+    return s;
+}
+
+/*
+ * CRC16, CRC16CCITT, CRC32
+ */
+
+static void crc_update(void *ctx, const uint8_t *data, size_t len)
+{
+    struct digest_crc *c = ctx;
+
+    switch (c->kind) {
+    case CRC16:
+        c->crc = crc16_reflect(0xa001, c->crc, data, len);
+        break;
+    case CRC16_CCITT:
+        c->crc = crc16_itu_t(c->crc, data, len);
+        break;
+    default:
+        c->crc = crc32_ieee_update(c->crc, data, len);
+        break;
+    }
+}
+
+/* The CRC computed by a class, from the class itself or an instance */
+static int crc_kind_of(const mrbc_value *self)
+{
+    mrbc_class *cls = (self->tt == MRBC_TT_CLASS) ? self->cls : self->instance->cls;
+
+    for (int i = 0; i < CRC_KINDS; i++) {
+        if (crc_class[i] == cls) {
+            return i;
+        }
+    }
+    return CRC32;
+}
+
+/* The CRC of the instance, or of the argument when called on the class */
+static int crc_value(mrbc_vm *vm, mrbc_value *v, int argc, struct digest_crc *out)
+{
+    if (v[0].tt != MRBC_TT_CLASS) {
+        *out = *(struct digest_crc *)v[0].instance->data;
+        return 0;
+    }
+
+    mrbc_value *data = one_shot_arg(vm, v, argc, 1);
+    if (!data) {
+        return -1;
+    }
+    out->kind = crc_kind_of(&v[0]);
+    out->crc = crc_init[out->kind];
+    return feed(vm, data, crc_update, out);
+}
+
+static void c_crc_new(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value obj = mrbc_instance_new(vm, v[0].cls, sizeof(struct digest_crc));
+    struct digest_crc *c = (struct digest_crc *)obj.instance->data;
+
+    c->kind = crc_kind_of(&v[0]);
+    c->crc = crc_init[c->kind];
+    SET_RETURN(obj);
+}
+
+static void c_crc_update(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+    feed(vm, &v[1], crc_update, v[0].instance->data);
+}
+
+static void c_crc_reset(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_crc *c = (struct digest_crc *)v[0].instance->data;
+
+    c->crc = crc_init[c->kind];
+}
+
+/* CRC32.checksum(data) or crc.checksum: the CRC as an Integer */
+static void c_crc_checksum(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_crc c;
+
+    if (crc_value(vm, v, argc, &c) == 0) {
+        SET_INT_RETURN((mrbc_int_t)c.crc);
+    }
+}
+
+/* The CRC as big-endian bytes; returns their count */
+static int crc_bytes(const struct digest_crc *c, uint8_t *d)
+{
+    int n = crc_size[c->kind];
+
+    for (int i = 0; i < n; i++) {
+        d[i] = c->crc >> (8 * (n - 1 - i));
+    }
+    return n;
+}
+
+/* CRC32.digest(data) or crc.digest: the CRC as big-endian bytes */
+static void c_crc_digest(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_crc c;
+    uint8_t d[4];
+
+    if (crc_value(vm, v, argc, &c) == 0) {
+        int n = crc_bytes(&c, d);
+        SET_RETURN(mrbc_string_new(vm, d, n));
+    }
+}
+
+static void c_crc_hexdigest(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_crc c;
+    uint8_t d[4];
+
+    if (crc_value(vm, v, argc, &c) == 0) {
+        int n = crc_bytes(&c, d);
+        SET_RETURN(hex_string(vm, d, n));
+    }
+}
+
+/*
+ * SHA256
+ */
+
+static void sha256_update(void *ctx, const uint8_t *data, size_t len)
+{
+    psa_hash_update(ctx, data, len);
+}
+
+/* Finish a copy of op, so the original can take more input */
+static int sha256_peek(mrbc_vm *vm, const psa_hash_operation_t *op, uint8_t *digest)
+{
+    psa_hash_operation_t copy = PSA_HASH_OPERATION_INIT;
+    size_t len;
+
+    if (psa_hash_clone(op, &copy) != PSA_SUCCESS ||
+        psa_hash_finish(&copy, digest, SHA256_SIZE, &len) != PSA_SUCCESS) {
+        psa_hash_abort(&copy);
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* SHA-256 of the instance, or of the argument when called on the class */
+static int sha256_value(mrbc_vm *vm, mrbc_value *v, int argc, uint8_t *digest)
+{
+    if (v[0].tt != MRBC_TT_CLASS) {
+        struct digest_sha256 *s = (struct digest_sha256 *)v[0].instance->data;
+        return sha256_peek(vm, &s->op, digest);
+    }
+
+    mrbc_value *data = one_shot_arg(vm, v, argc, 1);
+    if (!data) {
+        return -1;
+    }
+
+    psa_hash_operation_t op = PSA_HASH_OPERATION_INIT;
+    size_t len;
+    if (psa_hash_setup(&op, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+        return -1;
+    }
+    if (feed(vm, data, sha256_update, &op) < 0) {
+        psa_hash_abort(&op);
+        return -1;
+    }
+    if (psa_hash_finish(&op, digest, SHA256_SIZE, &len) != PSA_SUCCESS) {
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+        return -1;
+    }
+    return 0;
+}
+
+static void sha256_free(mrbc_value *self)
+{
+    struct digest_sha256 *s = (struct digest_sha256 *)self->instance->data;
+
+    psa_hash_abort(&s->op);
+}
+
+static void c_sha256_new(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value obj = mrbc_instance_new(vm, sha256_class, sizeof(struct digest_sha256));
+    struct digest_sha256 *s = (struct digest_sha256 *)obj.instance->data;
+
+    s->op = (psa_hash_operation_t)PSA_HASH_OPERATION_INIT;
+    if (psa_hash_setup(&s->op, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+        mrbc_decref(&obj);
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+        return;
+    }
+    SET_RETURN(obj);
+}
+
+static void c_sha256_update(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_sha256 *s = (struct digest_sha256 *)v[0].instance->data;
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+    feed(vm, &v[1], sha256_update, &s->op);
+}
+
+static void c_sha256_reset(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_sha256 *s = (struct digest_sha256 *)v[0].instance->data;
+
+    psa_hash_abort(&s->op);
+    psa_hash_setup(&s->op, PSA_ALG_SHA_256);
+}
+
+static void c_sha256_digest(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint8_t digest[SHA256_SIZE];
+
+    if (sha256_value(vm, v, argc, digest) == 0) {
+        SET_RETURN(mrbc_string_new(vm, digest, SHA256_SIZE));
+    }
+}
+
+static void c_sha256_hexdigest(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint8_t digest[SHA256_SIZE];
+
+    if (sha256_value(vm, v, argc, digest) == 0) {
+        SET_RETURN(hex_string(vm, digest, SHA256_SIZE));
+    }
+}
+
+#ifdef CONFIG_FILE_SYSTEM
+/* Only the VM thread reads files through here, so one buffer serves all */
+static uint8_t file_buf[CONFIG_HAKO_DIGEST_FILE_BUFFER];
+
+/* Digest::SHA256.file(path): a SHA256 instance holding the file's hash */
+static void c_sha256_file(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    const char *path = (const char *)v[1].string->data;
+    struct fs_file_t file;
+    fs_file_t_init(&file);
+    int rc = fs_open(&file, path, FS_O_READ);
+    if (rc < 0) {
+        mrbc_raisef(vm, MRBC_CLASS(RuntimeError), "cannot open %s (%d)", path, rc);
+        return;
+    }
+
+    mrbc_value obj = mrbc_instance_new(vm, sha256_class, sizeof(struct digest_sha256));
+    struct digest_sha256 *s = (struct digest_sha256 *)obj.instance->data;
+    s->op = (psa_hash_operation_t)PSA_HASH_OPERATION_INIT;
+
+    ssize_t n = -EIO;
+    if (psa_hash_setup(&s->op, PSA_ALG_SHA_256) == PSA_SUCCESS) {
+        while ((n = fs_read(&file, file_buf, sizeof(file_buf))) > 0) {
+            psa_hash_update(&s->op, file_buf, n);
+        }
+    }
+    fs_close(&file);
+
+    if (n < 0) {
+        mrbc_decref(&obj);
+        mrbc_raisef(vm, MRBC_CLASS(RuntimeError), "cannot read %s (%d)", path, (int)n);
+        return;
+    }
+    SET_RETURN(obj);
+}
+#endif
+
+/*
+ * HMAC (SHA-256)
+ */
+
+static int hmac_start(mrbc_vm *vm, struct digest_hmac *h, const mrbc_value *key)
+{
+    uint8_t k[SHA256_BLOCK_SIZE] = {0};
+    size_t len;
+
+    if (key->tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return -1;
+    }
+
+    /* keys longer than a block are hashed first (RFC 2104) */
+    if (key->string->size > SHA256_BLOCK_SIZE) {
+        if (psa_hash_compute(PSA_ALG_SHA_256, key->string->data, key->string->size,
+                             k, SHA256_SIZE, &len) != PSA_SUCCESS) {
+            mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+            return -1;
+        }
+    } else {
+        memcpy(k, key->string->data, key->string->size);
+    }
+
+    uint8_t ipad[SHA256_BLOCK_SIZE];
+    for (int i = 0; i < SHA256_BLOCK_SIZE; i++) {
+        ipad[i] = k[i] ^ 0x36;
+        h->opad[i] = k[i] ^ 0x5c;
+    }
+
+    h->inner = (psa_hash_operation_t)PSA_HASH_OPERATION_INIT;
+    int ok = psa_hash_setup(&h->inner, PSA_ALG_SHA_256) == PSA_SUCCESS &&
+             psa_hash_update(&h->inner, ipad, sizeof(ipad)) == PSA_SUCCESS;
+    memset(k, 0, sizeof(k));
+    memset(ipad, 0, sizeof(ipad));
+    if (!ok) {
+        psa_hash_abort(&h->inner);
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+        return -1;
+    }
+    return 0;
+}
+
+/* H(opad || H(ipad || data)), leaving the inner hash open */
+static int hmac_peek(mrbc_vm *vm, const struct digest_hmac *h, uint8_t *mac)
+{
+    psa_hash_operation_t outer = PSA_HASH_OPERATION_INIT;
+    uint8_t inner[SHA256_SIZE];
+    size_t len;
+
+    if (sha256_peek(vm, &h->inner, inner) < 0) {
+        return -1;
+    }
+    if (psa_hash_setup(&outer, PSA_ALG_SHA_256) != PSA_SUCCESS ||
+        psa_hash_update(&outer, h->opad, sizeof(h->opad)) != PSA_SUCCESS ||
+        psa_hash_update(&outer, inner, sizeof(inner)) != PSA_SUCCESS ||
+        psa_hash_finish(&outer, mac, SHA256_SIZE, &len) != PSA_SUCCESS) {
+        psa_hash_abort(&outer);
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "SHA-256 failed");
+        return -1;
+    }
+    return 0;
+}
+
+static void hmac_clear(struct digest_hmac *h)
+{
+    psa_hash_abort(&h->inner);
+    memset(h->opad, 0, sizeof(h->opad));
+}
+
+/* HMAC of the instance, or of (key, data) when called on the class */
+static int hmac_value(mrbc_vm *vm, mrbc_value *v, int argc, uint8_t *mac)
+{
+    if (v[0].tt != MRBC_TT_CLASS) {
+        return hmac_peek(vm, (struct digest_hmac *)v[0].instance->data, mac);
+    }
+
+    mrbc_value *data = one_shot_arg(vm, v, argc, 2);
+    if (!data) {
+        return -1;
+    }
+
+    struct digest_hmac h;
+    if (hmac_start(vm, &h, &v[1]) < 0) {
+        return -1;
+    }
+    int rc = feed(vm, data, sha256_update, &h.inner);
+    if (rc == 0) {
+        rc = hmac_peek(vm, &h, mac);
+    }
+    hmac_clear(&h);
+    return rc;
+}
+
+static void hmac_free(mrbc_value *self)
+{
+    hmac_clear((struct digest_hmac *)self->instance->data);
+}
+
+/* Digest::HMAC.new(key) */
+static void c_hmac_new(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments (given 0, expected 1)");
+        return;
+    }
+
+    mrbc_value obj = mrbc_instance_new(vm, hmac_class, sizeof(struct digest_hmac));
+    struct digest_hmac *h = (struct digest_hmac *)obj.instance->data;
+
+    memset(h, 0, sizeof(*h));
+    if (hmac_start(vm, h, &v[1]) < 0) {
+        mrbc_decref(&obj);
+        return;
+    }
+    SET_RETURN(obj);
+}
+
+static void c_hmac_update(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct digest_hmac *h = (struct digest_hmac *)v[0].instance->data;
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+    feed(vm, &v[1], sha256_update, &h->inner);
+}
+
+static void c_hmac_digest(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint8_t mac[SHA256_SIZE];
+
+    if (hmac_value(vm, v, argc, mac) == 0) {
+        SET_RETURN(mrbc_string_new(vm, mac, SHA256_SIZE));
+    }
+}
+
+static void c_hmac_hexdigest(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    uint8_t mac[SHA256_SIZE];
+
+    if (hmac_value(vm, v, argc, mac) == 0) {
+        SET_RETURN(hex_string(vm, mac, SHA256_SIZE));
+    }
+}
+
+/**
+ * Initialize the Digest extension
+ */
+void mrbc_digest_init(void)
+{
+    static const char *const crc_names[CRC_KINDS] = { "CRC16", "CRC16CCITT", "CRC32" };
+    mrbc_class *digest = mrbc_define_module(0, "Digest");
+
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        LOG_ERR("PSA crypto init failed");
+    }
+
+    for (int i = 0; i < CRC_KINDS; i++) {
+        mrbc_class *cls = mrbc_define_class_under(0, digest, crc_names[i], mrbc_class_object);
+        crc_class[i] = cls;
+        mrbc_define_method(0, cls, "new", c_crc_new);
+        mrbc_define_method(0, cls, "update", c_crc_update);
+        mrbc_define_method(0, cls, "<<", c_crc_update);
+        mrbc_define_method(0, cls, "reset", c_crc_reset);
+        mrbc_define_method(0, cls, "checksum", c_crc_checksum);
+        mrbc_define_method(0, cls, "digest", c_crc_digest);
+        mrbc_define_method(0, cls, "hexdigest", c_crc_hexdigest);
+    }
+
+    sha256_class = mrbc_define_class_under(0, digest, "SHA256", mrbc_class_object);
+    mrbc_define_destructor(sha256_class, sha256_free);
+    mrbc_define_method(0, sha256_class, "new", c_sha256_new);
+    mrbc_define_method(0, sha256_class, "update", c_sha256_update);
+    mrbc_define_method(0, sha256_class, "<<", c_sha256_update);
+    mrbc_define_method(0, sha256_class, "reset", c_sha256_reset);
+    mrbc_define_method(0, sha256_class, "digest", c_sha256_digest);
+    mrbc_define_method(0, sha256_class, "hexdigest", c_sha256_hexdigest);
+#ifdef CONFIG_FILE_SYSTEM
+    mrbc_define_method(0, sha256_class, "file", c_sha256_file);
+#endif
+
+    hmac_class = mrbc_define_class_under(0, digest, "HMAC", mrbc_class_object);
+    mrbc_define_destructor(hmac_class, hmac_free);
+    mrbc_define_method(0, hmac_class, "new", c_hmac_new);
+    mrbc_define_method(0, hmac_class, "update", c_hmac_update);
+    mrbc_define_method(0, hmac_class, "<<", c_hmac_update);
+    mrbc_define_method(0, hmac_class, "digest", c_hmac_digest);
+    mrbc_define_method(0, hmac_class, "hexdigest", c_hmac_hexdigest);
+
+    LOG_DBG("Digest registered");
+}
+
+HAKO_EXTENSION_DEFINE(digest, mrbc_digest_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
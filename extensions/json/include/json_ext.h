@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file json_ext.h
+ * @brief JSON extension public API
+ */
+
+#ifndef JSON_EXT_H
+#define JSON_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the JSON extension
+ *
+ * Registers the JSON module, JSON::PullParser and the JSON error
+ * classes with the mruby/c VM. Called automatically by HAKO loader
+ * during initialization.
+ */
+void mrbc_json_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* JSON_EXT_H */
@@ -0,0 +1,1071 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file json.c
+ * @brief JSON.parse, JSON.generate and JSON::PullParser
+ *
+ * JSON.parse builds Hashes and Arrays directly while scanning the text.
+ * JSON.generate measures its output first, then writes it into a single
+ * String of exactly that size. JSON::PullParser takes the text in chunks
+ * and returns one event at a time, keeping only the unread input.
+ */
+
+#include <hako/extension.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_ext.h"
+
+LOG_MODULE_REGISTER(hako_json, CONFIG_HAKO_LOG_LEVEL);
+
+/* Longest number text accepted, and longest key symbolized on the stack */
+#define JSON_NUMBER_MAX 40
+#define JSON_KEY_STACK  64
+
+#define JSON_INT_MIN (-(mrbc_int_t)(~(mrbc_uint_t)0 >> 1) - 1)
+
+enum {
+    JSON_OK = 0,
+    JSON_ERROR = -1,
+    JSON_MORE = -2,     /* token runs past the end of the input so far */
+};
+
+struct json_scan {
+    mrbc_vm *vm;
+    const uint8_t *start;
+    const uint8_t *p;
+    const uint8_t *end;
+    int offset;         /* input offset of start, for error messages */
+    int final;          /* nothing follows end */
+    int symbolize;
+};
+
+static mrbc_class *parser_error_class;
+static mrbc_class *generator_error_class;
+static mrbc_class *pull_parser_class;
+static mrbc_sym sym_symbolize_names;
+
+/*
+ * Scanner
+ */
+
+static int json_error(struct json_scan *s, const char *msg)
+{
+    mrbc_raisef(s->vm, parser_error_class, "%s at offset %d", msg,
+                s->offset + (int)(s->p - s->start));
+    return JSON_ERROR;
+}
+
+static int json_nomem(struct json_scan *s)
+{
+    mrbc_raise(s->vm, MRBC_CLASS(NoMemoryError), "out of memory");
+    return JSON_ERROR;
+}
+
+/* Running out of input is an error only when no more can follow */
+static int json_short(struct json_scan *s)
+{
+    return s->final ? json_error(s, "unexpected end of input") : JSON_MORE;
+}
+
+static void skip_ws(struct json_scan *s)
+{
+    while (s->p < s->end &&
+           (*s->p == ' ' || *s->p == '\n' || *s->p == '\r' || *s->p == '\t')) {
+        s->p++;
+    }
+}
+
+static int hex4(const uint8_t *p)
+{
+    int v = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int c = p[i];
+        if (c >= '0' && c <= '9') {
+            c -= '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            c = (c | 0x20) - 'a' + 10;
+        } else {
+            return -1;
+        }
+        v = v * 16 + c;
+    }
+    return v;
+}
+
+/* Decode the escaped string body [p, end) into dst; returns the length */
+static int unescape(struct json_scan *s, const uint8_t *p, const uint8_t *end, uint8_t *dst)
+{
+    uint8_t *d = dst;
+
+    while (p < end) {
+        if (*p != '\\') {
+            *d++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p++) {
+        case '"':  *d++ = '"'; break;
+        case '\\': *d++ = '\\'; break;
+        case '/':  *d++ = '/'; break;
+        case 'b':  *d++ = '\b'; break;
+        case 'f':  *d++ = '\f'; break;
+        case 'n':  *d++ = '\n'; break;
+        case 'r':  *d++ = '\r'; break;
+        case 't':  *d++ = '\t'; break;
+        case 'u': {
+            int cp = (end - p >= 4) ? hex4(p) : -1;
+            if (cp < 0) {
+                return json_error(s, "invalid unicode escape");
+            }
+            p += 4;
+            if (cp >= 0xd800 && cp <= 0xdbff) {
+                int lo = (end - p >= 6 && p[0] == '\\' && p[1] == 'u') ? hex4(p + 2) : -1;
+                if (lo < 0xdc00 || lo > 0xdfff) {
+                    return json_error(s, "invalid surrogate pair");
+                }
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                p += 6;
+            } else if (cp >= 0xdc00 && cp <= 0xdfff) {
+                return json_error(s, "invalid surrogate pair");
+            }
+
+            if (cp < 0x80) {
+                *d++ = cp;
+            } else if (cp < 0x800) {
+                *d++ = 0xc0 | (cp >> 6);
+                *d++ = 0x80 | (cp & 0x3f);
+            } else if (cp < 0x10000) {
+                *d++ = 0xe0 | (cp >> 12);
+                *d++ = 0x80 | ((cp >> 6) & 0x3f);
+                *d++ = 0x80 | (cp & 0x3f);
+            } else {
+                *d++ = 0xf0 | (cp >> 18);
+                *d++ = 0x80 | ((cp >> 12) & 0x3f);
+                *d++ = 0x80 | ((cp >> 6) & 0x3f);
+                *d++ = 0x80 | (cp & 0x3f);
+            }
+            break;
+        }
+        default:
+            return json_error(s, "invalid escape");
+        }
+    }
+    return d - dst;
+}
+
+static int make_symbol(struct json_scan *s, const uint8_t *p, const uint8_t *end,
+                       int escaped, mrbc_value *out)
+{
+    uint8_t local[JSON_KEY_STACK];
+    int len = end - p;
+    uint8_t *buf = (len < JSON_KEY_STACK) ? local : mrbc_alloc(s->vm, len + 1);
+
+    if (!buf) {
+        return json_nomem(s);
+    }
+    if (escaped) {
+        len = unescape(s, p, end, buf);
+    } else {
+        memcpy(buf, p, len);
+    }
+    if (len >= 0) {
+        buf[len] = '\0';
+        *out = mrbc_symbol_new(s->vm, (const char *)buf);
+    }
+    if (buf != local) {
+        mrbc_free(s->vm, buf);
+    }
+    return (len < 0) ? JSON_ERROR : JSON_OK;
+}
+
+/* Scan a string at s->p (the opening quote) into a String or Symbol */
+static int scan_string(struct json_scan *s, mrbc_value *out, int as_symbol)
+{
+    const uint8_t *p = s->p + 1;
+    const uint8_t *q = p;
+    int escaped = 0;
+
+    for (;;) {
+        if (q >= s->end) {
+            return json_short(s);
+        }
+        if (*q == '"') {
+            break;
+        }
+        if (*q < 0x20) {
+            s->p = q;
+            return json_error(s, "control character in string");
+        }
+        if (*q == '\\') {
+            if (q + 1 >= s->end) {
+                return json_short(s);
+            }
+            escaped = 1;
+            q += 2;
+            continue;
+        }
+        q++;
+    }
+
+    int ret = JSON_OK;
+    if (as_symbol) {
+        ret = make_symbol(s, p, q, escaped, out);
+    } else if (!escaped) {
+        *out = mrbc_string_new(s->vm, p, q - p);
+        if (out->tt != MRBC_TT_STRING || !out->string) {
+            return json_nomem(s);
+        }
+    } else {
+        /* the decoded text is never longer than the escaped one */
+        mrbc_value str = mrbc_string_new(s->vm, NULL, q - p);
+        if (str.tt != MRBC_TT_STRING || !str.string) {
+            return json_nomem(s);
+        }
+        int len = unescape(s, p, q, str.string->data);
+        if (len < 0) {
+            mrbc_decref(&str);
+            return JSON_ERROR;
+        }
+        str.string->size = len;
+        str.string->data[len] = '\0';
+        *out = str;
+    }
+    s->p = q + 1;
+    return ret;
+}
+
+static int is_digit(const uint8_t *q, const uint8_t *end)
+{
+    return q < end && *q >= '0' && *q <= '9';
+}
+
+static int scan_number(struct json_scan *s, mrbc_value *out)
+{
+    const uint8_t *q = s->p;
+    const uint8_t *end = s->end;
+    int is_float = 0;
+
+    if (q < end && *q == '-') {
+        q++;
+    }
+    if (!is_digit(q, end)) {
+        return (q >= end) ? json_short(s) : json_error(s, "invalid number");
+    }
+    if (*q == '0') {
+        q++;
+    } else {
+        while (is_digit(q, end)) {
+            q++;
+        }
+    }
+    if (q < end && *q == '.') {
+        is_float = 1;
+        q++;
+        if (!is_digit(q, end)) {
+            return (q >= end) ? json_short(s) : json_error(s, "invalid number");
+        }
+        while (is_digit(q, end)) {
+            q++;
+        }
+    }
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        is_float = 1;
+        q++;
+        if (q < end && (*q == '+' || *q == '-')) {
+            q++;
+        }
+        if (!is_digit(q, end)) {
+            return (q >= end) ? json_short(s) : json_error(s, "invalid number");
+        }
+        while (is_digit(q, end)) {
+            q++;
+        }
+    }
+    if (q >= end && !s->final) {
+        /* more digits may follow */
+        return JSON_MORE;
+    }
+
+    if (!is_float) {
+        const uint8_t *d = s->p + (*s->p == '-');
+        mrbc_int_t v = 0;
+        int overflow = 0;
+        /* accumulate negated, which reaches JSON_INT_MIN without overflow */
+        for (; d < q; d++) {
+            if (v < (JSON_INT_MIN + (*d - '0')) / 10) {
+                overflow = 1;
+                break;
+            }
+            v = v * 10 - (*d - '0');
+        }
+        if (!overflow && (*s->p == '-' || v != JSON_INT_MIN)) {
+            *out = mrbc_integer_value(*s->p == '-' ? v : -v);
+            s->p = q;
+            return JSON_OK;
+        }
+        /* too big for an Integer: fall through to Float */
+    }
+
+#if MRBC_USE_FLOAT
+    char buf[JSON_NUMBER_MAX];
+    if (q - s->p >= JSON_NUMBER_MAX) {
+        return json_error(s, "number too long");
+    }
+    memcpy(buf, s->p, q - s->p);
+    buf[q - s->p] = '\0';
+    *out = mrbc_float_value(s->vm, strtod(buf, NULL));
+    s->p = q;
+    return JSON_OK;
+#else
+    return json_error(s, is_float ? "floats are not supported" : "number too big");
+#endif
+}
+
+static int scan_literal(struct json_scan *s, const char *word, mrbc_value value, mrbc_value *out)
+{
+    size_t len = strlen(word);
+    size_t avail = s->end - s->p;
+
+    if (memcmp(s->p, word, avail < len ? avail : len) != 0) {
+        return json_error(s, "unexpected token");
+    }
+    if (avail < len) {
+        return json_short(s);
+    }
+    s->p += len;
+    *out = value;
+    return JSON_OK;
+}
+
+/* Scan a string, number or literal */
+static int scan_scalar(struct json_scan *s, mrbc_value *out)
+{
+    switch (*s->p) {
+    case '"':
+        return scan_string(s, out, 0);
+    case 't':
+        return scan_literal(s, "true", mrbc_true_value(), out);
+    case 'f':
+        return scan_literal(s, "false", mrbc_false_value(), out);
+    case 'n':
+        return scan_literal(s, "null", mrbc_nil_value(), out);
+    default:
+        if (*s->p == '-' || (*s->p >= '0' && *s->p <= '9')) {
+            return scan_number(s, out);
+        }
+        return json_error(s, "unexpected character");
+    }
+}
+
+/*
+ * JSON.parse
+ */
+
+static int parse_value(struct json_scan *s, mrbc_value *out, int depth);
+
+static int parse_array(struct json_scan *s, mrbc_value *out, int depth)
+{
+    mrbc_value ary = mrbc_array_new(s->vm, 0);
+    if (ary.tt != MRBC_TT_ARRAY || !ary.array) {
+        return json_nomem(s);
+    }
+
+    s->p++;
+    skip_ws(s);
+    if (s->p < s->end && *s->p == ']') {
+        s->p++;
+        *out = ary;
+        return JSON_OK;
+    }
+
+    for (;;) {
+        mrbc_value item;
+        if (parse_value(s, &item, depth) < 0) {
+            goto fail;
+        }
+        if (mrbc_array_push(&ary, &item) != 0) {
+            mrbc_decref(&item);
+            json_nomem(s);
+            goto fail;
+        }
+
+        skip_ws(s);
+        if (s->p < s->end && *s->p == ',') {
+            s->p++;
+        } else if (s->p < s->end && *s->p == ']') {
+            s->p++;
+            *out = ary;
+            return JSON_OK;
+        } else {
+            json_error(s, "expected ',' or ']'");
+            goto fail;
+        }
+    }
+
+fail:
+    mrbc_decref(&ary);
+    return JSON_ERROR;
+}
+
+static int parse_object(struct json_scan *s, mrbc_value *out, int depth)
+{
+    mrbc_value hash = mrbc_hash_new(s->vm, 0);
+    if (hash.tt != MRBC_TT_HASH || !hash.hash) {
+        return json_nomem(s);
+    }
+
+    s->p++;
+    skip_ws(s);
+    if (s->p < s->end && *s->p == '}') {
+        s->p++;
+        *out = hash;
+        return JSON_OK;
+    }
+
+    for (;;) {
+        mrbc_value key;
+        mrbc_value val;
+
+        skip_ws(s);
+        if (s->p >= s->end || *s->p != '"') {
+            json_error(s, "expected object key");
+            goto fail;
+        }
+        if (scan_string(s, &key, s->symbolize) < 0) {
+            goto fail;
+        }
+        skip_ws(s);
+        if (s->p >= s->end || *s->p != ':') {
+            mrbc_decref(&key);
+            json_error(s, "expected ':'");
+            goto fail;
+        }
+        s->p++;
+        if (parse_value(s, &val, depth) < 0) {
+            mrbc_decref(&key);
+            goto fail;
+        }
+        if (mrbc_hash_set(&hash, &key, &val) != 0) {
+            mrbc_decref(&key);
+            mrbc_decref(&val);
+            json_nomem(s);
+            goto fail;
+        }
+
+        skip_ws(s);
+        if (s->p < s->end && *s->p == ',') {
+            s->p++;
+        } else if (s->p < s->end && *s->p == '}') {
+            s->p++;
+            *out = hash;
+            return JSON_OK;
+        } else {
+            json_error(s, "expected ',' or '}'");
+            goto fail;
+        }
+    }
+
+fail:
+    mrbc_decref(&hash);
+    return JSON_ERROR;
+}
+
+static int parse_value(struct json_scan *s, mrbc_value *out, int depth)
+{
+    skip_ws(s);
+    if (s->p >= s->end) {
+        return json_error(s, "unexpected end of input");
+    }
+    if (*s->p == '[' || *s->p == '{') {
+        if (depth >= CONFIG_HAKO_JSON_MAX_DEPTH) {
+            return json_error(s, "nesting too deep");
+        }
+        return (*s->p == '[') ? parse_array(s, out, depth + 1) : parse_object(s, out, depth + 1);
+    }
+    return scan_scalar(s, out);
+}
+
+/* symbolize_names: true in a trailing options Hash after nargs arguments */
+static int opt_symbolize(mrbc_value *v, int argc, int nargs)
+{
+    if (argc <= nargs || v[argc].tt != MRBC_TT_HASH) {
+        return 0;
+    }
+
+    mrbc_value key = mrbc_symbol_value(sym_symbolize_names);
+    mrbc_value val = mrbc_hash_get(&v[argc], &key);
+    return val.tt != MRBC_TT_NIL && val.tt != MRBC_TT_FALSE;
+}
+
+static void c_json_parse(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    struct json_scan s = {
+        .vm = vm,
+        .start = v[1].string->data,
+        .p = v[1].string->data,
+        .end = v[1].string->data + v[1].string->size,
+        .final = 1,
+        .symbolize = opt_symbolize(v, argc, 1),
+    };
+    mrbc_value result;
+
+    if (parse_value(&s, &result, 0) < 0) {
+        return;
+    }
+    skip_ws(&s);
+    if (s.p != s.end) {
+        mrbc_decref(&result);
+        json_error(&s, "unexpected data after document");
+        return;
+    }
+    SET_RETURN(result);
+}
+
+/*
+ * JSON.generate
+ */
+
+struct json_gen {
+    mrbc_vm *vm;
+    uint8_t *buf;       /* NULL while measuring */
+    int len;
+};
+
+static void gen_bytes(struct json_gen *g, const void *p, int n)
+{
+    if (g->buf) {
+        memcpy(g->buf + g->len, p, n);
+    }
+    g->len += n;
+}
+
+static void gen_string(struct json_gen *g, const uint8_t *p, int n)
+{
+    static const char hex[] = "0123456789abcdef";
+    int run = 0;
+
+    gen_bytes(g, "\"", 1);
+    for (int i = 0; i < n; i++) {
+        uint8_t c = p[i];
+        char esc[6] = { '\\', 0 };
+        int elen = 2;
+
+        switch (c) {
+        case '"':  esc[1] = '"'; break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b'; break;
+        case '\f': esc[1] = 'f'; break;
+        case '\n': esc[1] = 'n'; break;
+        case '\r': esc[1] = 'r'; break;
+        case '\t': esc[1] = 't'; break;
+        default:
+            if (c >= 0x20) {
+                continue;
+            }
+            memcpy(esc, "\\u00", 4);
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 15];
+            elen = 6;
+            break;
+        }
+        gen_bytes(g, p + run, i - run);
+        gen_bytes(g, esc, elen);
+        run = i + 1;
+    }
+    gen_bytes(g, p + run, n - run);
+    gen_bytes(g, "\"", 1);
+}
+
+static int format_int(char *buf, mrbc_int_t v)
+{
+    char tmp[24];
+    int n = 0;
+    int len = 0;
+    int neg = v < 0;
+
+    /* build the digits from the negative value, which cannot overflow */
+    if (!neg) {
+        v = -v;
+    }
+    do {
+        tmp[n++] = '0' - (char)(v % 10);
+        v /= 10;
+    } while (v);
+
+    if (neg) {
+        buf[len++] = '-';
+    }
+    while (n) {
+        buf[len++] = tmp[--n];
+    }
+    return len;
+}
+
+#if MRBC_USE_FLOAT
+/* Shortest form that reads back as the same value, with ".0" as Ruby does */
+static int format_float(char *buf, double d)
+{
+    int len = 0;
+
+    for (int prec = 15; prec <= 17; prec++) {
+        len = snprintf(buf, 32, "%.*g", prec, d);
+        if (strtod(buf, NULL) == d) {
+            break;
+        }
+    }
+    if (!strchr(buf, '.')) {
+        char *e = strchr(buf, 'e');
+        if (!e) {
+            e = buf + len;
+        }
+        memmove(e + 2, e, buf + len - e + 1);
+        memcpy(e, ".0", 2);
+        len += 2;
+    }
+    return len;
+}
+#endif
+
+static int gen_value(struct json_gen *g, mrbc_value *v, int depth)
+{
+    char num[32];
+
+    switch (v->tt) {
+    case MRBC_TT_NIL:
+        gen_bytes(g, "null", 4);
+        return 0;
+    case MRBC_TT_TRUE:
+        gen_bytes(g, "true", 4);
+        return 0;
+    case MRBC_TT_FALSE:
+        gen_bytes(g, "false", 5);
+        return 0;
+    case MRBC_TT_INTEGER:
+        gen_bytes(g, num, format_int(num, v->i));
+        return 0;
+#if MRBC_USE_FLOAT
+    case MRBC_TT_FLOAT:
+        if (v->d != v->d || v->d - v->d != 0) {
+            mrbc_raise(g->vm, generator_error_class, "NaN and Infinity are not allowed in JSON");
+            return -1;
+        }
+        gen_bytes(g, num, format_float(num, v->d));
+        return 0;
+#endif
+    case MRBC_TT_STRING:
+        gen_string(g, v->string->data, v->string->size);
+        return 0;
+    case MRBC_TT_SYMBOL: {
+        const char *name = mrbc_symid_to_str(v->sym_id);
+        gen_string(g, (const uint8_t *)name, strlen(name));
+        return 0;
+    }
+    case MRBC_TT_ARRAY:
+    case MRBC_TT_HASH:
+        break;
+    default:
+        mrbc_raise(g->vm, generator_error_class, "only nil, true, false, numbers, Strings, Symbols, Arrays and Hashes can be generated");
+        return -1;
+    }
+
+    if (depth >= CONFIG_HAKO_JSON_MAX_DEPTH) {
+        mrbc_raise(g->vm, generator_error_class, "nesting too deep");
+        return -1;
+    }
+
+    if (v->tt == MRBC_TT_ARRAY) {
+        gen_bytes(g, "[", 1);
+        for (int i = 0; i < v->array->n_stored; i++) {
+            if (i > 0) {
+                gen_bytes(g, ",", 1);
+            }
+            if (gen_value(g, &v->array->data[i], depth + 1) < 0) {
+                return -1;
+            }
+        }
+        gen_bytes(g, "]", 1);
+        return 0;
+    }
+
+    int first = 1;
+    mrbc_hash_iterator ite = mrbc_hash_iterator_new(v);
+
+    gen_bytes(g, "{", 1);
+    while (mrbc_hash_i_has_next(&ite)) {
+        mrbc_value *kv = mrbc_hash_i_next(&ite);
+
+        if (!first) {
+            gen_bytes(g, ",", 1);
+        }
+        first = 0;
+
+        /* keys are written as strings; Integer keys as their digits */
+        if (kv[0].tt == MRBC_TT_INTEGER) {
+            gen_string(g, (const uint8_t *)num, format_int(num, kv[0].i));
+        } else if (kv[0].tt == MRBC_TT_STRING || kv[0].tt == MRBC_TT_SYMBOL) {
+            gen_value(g, &kv[0], depth + 1);
+        } else {
+            mrbc_raise(g->vm, generator_error_class, "Hash keys must be Strings, Symbols or Integers");
+            return -1;
+        }
+        gen_bytes(g, ":", 1);
+        if (gen_value(g, &kv[1], depth + 1) < 0) {
+            return -1;
+        }
+    }
+    gen_bytes(g, "}", 1);
+    return 0;
+}
+
+static void c_json_generate(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_gen g = { .vm = vm };
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+
+    /* measure, then write into a String of exactly that size */
+    if (gen_value(&g, &v[1], 0) < 0) {
+        return;
+    }
+
+    mrbc_value str = mrbc_string_new(vm, NULL, g.len);
+    if (str.tt != MRBC_TT_STRING || !str.string) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+    g.buf = str.string->data;
+    g.len = 0;
+    gen_value(&g, &v[1], 0);
+    g.buf[g.len] = '\0';
+    SET_RETURN(str);
+}
+
+/*
+ * JSON::PullParser
+ */
+
+enum {
+    PULL_VALUE,         /* a value is next */
+    PULL_KEY,           /* an object key is next */
+    PULL_NEXT,          /* ',' or the end of the container is next */
+    PULL_DONE,
+};
+
+struct json_pull {
+    uint8_t *buf;       /* unread input */
+    int len;
+    int cap;
+    int offset;         /* input offset of buf[0] */
+    uint8_t state;
+    uint8_t first;      /* the container may close without an element */
+    uint8_t final;
+    uint8_t symbolize;
+    uint8_t depth;
+    uint8_t stack[CONFIG_HAKO_JSON_MAX_DEPTH];     /* '[' or '{' */
+    mrbc_value value;
+};
+
+static mrbc_sym sym_start_object;
+static mrbc_sym sym_end_object;
+static mrbc_sym sym_start_array;
+static mrbc_sym sym_end_array;
+static mrbc_sym sym_key;
+static mrbc_sym sym_value;
+
+static void pull_free(mrbc_value *self)
+{
+    struct json_pull *jp = (struct json_pull *)self->instance->data;
+
+    mrbc_decref(&jp->value);
+    if (jp->buf) {
+        mrbc_raw_free(jp->buf);
+    }
+}
+
+static void pull_set_value(struct json_pull *jp, mrbc_value *v)
+{
+    mrbc_decref(&jp->value);
+    jp->value = *v;
+}
+
+static int pull_feed(mrbc_vm *vm, struct json_pull *jp, const uint8_t *data, int n)
+{
+    /* sized once: to the stream buffer, or to a whole document given to new */
+    if (!jp->buf) {
+        jp->cap = (n > CONFIG_HAKO_JSON_STREAM_BUFFER) ? n : CONFIG_HAKO_JSON_STREAM_BUFFER;
+        jp->buf = mrbc_raw_alloc(jp->cap);
+        if (!jp->buf) {
+            mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+            return -1;
+        }
+    }
+    if (jp->len + n > jp->cap) {
+        mrbc_raise(vm, parser_error_class, "stream buffer full; feed smaller chunks");
+        return -1;
+    }
+    memcpy(jp->buf + jp->len, data, n);
+    jp->len += n;
+    return 0;
+}
+
+/* JSON::PullParser.new(src = nil, symbolize_names: false) */
+static void c_pull_new(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value obj = mrbc_instance_new(vm, pull_parser_class, sizeof(struct json_pull));
+    if (!obj.instance) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+    struct json_pull *jp = (struct json_pull *)obj.instance->data;
+
+    memset(jp, 0, sizeof(*jp));
+    jp->value = mrbc_nil_value();
+    jp->state = PULL_VALUE;
+    jp->symbolize = opt_symbolize(v, argc, argc >= 1 && v[1].tt == MRBC_TT_STRING);
+
+    /* a whole document given up front */
+    if (argc >= 1 && v[1].tt == MRBC_TT_STRING) {
+        if (pull_feed(vm, jp, v[1].string->data, v[1].string->size) < 0) {
+            mrbc_decref(&obj);
+            return;
+        }
+        jp->final = 1;
+    }
+    SET_RETURN(obj);
+}
+
+static void c_pull_feed(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_pull *jp = (struct json_pull *)v[0].instance->data;
+
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+    if (jp->final) {
+        mrbc_raise(vm, parser_error_class, "input already finished");
+        return;
+    }
+    pull_feed(vm, jp, v[1].string->data, v[1].string->size);
+}
+
+static void c_pull_finish(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_pull *jp = (struct json_pull *)v[0].instance->data;
+
+    jp->final = 1;
+}
+
+/* Advance by one event; returns its symbol, or 0 if more input is needed */
+static mrbc_sym pull_next(mrbc_vm *vm, struct json_pull *jp)
+{
+    struct json_scan s = {
+        .vm = vm,
+        .start = jp->buf,
+        .p = jp->buf,
+        .end = jp->buf + jp->len,
+        .offset = jp->offset,
+        .final = jp->final,
+        .symbolize = jp->symbolize,
+    };
+    mrbc_sym event = 0;
+    mrbc_value val;
+
+    for (;;) {
+        skip_ws(&s);
+        if (jp->state == PULL_DONE) {
+            if (s.p < s.end) {
+                json_error(&s, "unexpected data after document");
+            }
+            break;
+        }
+        if (s.p >= s.end) {
+            if (jp->final) {
+                json_error(&s, "unexpected end of input");
+            }
+            break;
+        }
+
+        int c = *s.p;
+        uint8_t top = jp->depth ? jp->stack[jp->depth - 1] : 0;
+
+        if (jp->state == PULL_NEXT) {
+            if (c == ',') {
+                s.p++;
+                jp->state = (top == '{') ? PULL_KEY : PULL_VALUE;
+                jp->first = 0;
+                continue;
+            }
+            if ((c == ']' && top == '[') || (c == '}' && top == '{')) {
+                goto close;
+            }
+            json_error(&s, top == '[' ? "expected ',' or ']'" : "expected ',' or '}'");
+            break;
+        }
+
+        if (jp->state == PULL_KEY) {
+            if (c == '}' && jp->first) {
+                goto close;
+            }
+            if (c != '"') {
+                json_error(&s, "expected object key");
+                break;
+            }
+            /* the key and its ':' are consumed together */
+            const uint8_t *save = s.p;
+            int ret = scan_string(&s, &val, jp->symbolize);
+            if (ret == JSON_OK) {
+                skip_ws(&s);
+                if (s.p >= s.end) {
+                    mrbc_decref(&val);
+                    s.p = save;
+                    if (jp->final) {
+                        json_error(&s, "unexpected end of input");
+                    }
+                    break;
+                }
+                if (*s.p != ':') {
+                    mrbc_decref(&val);
+                    json_error(&s, "expected ':'");
+                    break;
+                }
+                s.p++;
+                pull_set_value(jp, &val);
+                jp->state = PULL_VALUE;
+                jp->first = 0;
+                event = sym_key;
+            }
+            break;
+        }
+
+        /* PULL_VALUE */
+        if (c == ']' && jp->first && top == '[') {
+            goto close;
+        }
+        if (c == '[' || c == '{') {
+            if (jp->depth >= CONFIG_HAKO_JSON_MAX_DEPTH) {
+                json_error(&s, "nesting too deep");
+                break;
+            }
+            s.p++;
+            jp->stack[jp->depth++] = c;
+            jp->state = (c == '{') ? PULL_KEY : PULL_VALUE;
+            jp->first = 1;
+            val = mrbc_nil_value();
+            pull_set_value(jp, &val);
+            event = (c == '{') ? sym_start_object : sym_start_array;
+            break;
+        }
+        if (scan_scalar(&s, &val) == JSON_OK) {
+            pull_set_value(jp, &val);
+            jp->state = jp->depth ? PULL_NEXT : PULL_DONE;
+            event = sym_value;
+        }
+        break;
+
+close:
+        s.p++;
+        jp->depth--;
+        jp->state = jp->depth ? PULL_NEXT : PULL_DONE;
+        val = mrbc_nil_value();
+        pull_set_value(jp, &val);
+        event = (c == ']') ? sym_end_array : sym_end_object;
+        break;
+    }
+
+    /* drop the consumed input */
+    int used = s.p - jp->buf;
+    if (used > 0) {
+        memmove(jp->buf, s.p, jp->len - used);
+        jp->len -= used;
+        jp->offset += used;
+    }
+    return event;
+}
+
+static void c_pull_next(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_pull *jp = (struct json_pull *)v[0].instance->data;
+    mrbc_sym event = pull_next(vm, jp);
+
+    if (event) {
+        SET_RETURN(mrbc_symbol_value(event));
+    } else {
+        SET_NIL_RETURN();
+    }
+}
+
+static void c_pull_value(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_pull *jp = (struct json_pull *)v[0].instance->data;
+
+    mrbc_incref(&jp->value);
+    SET_RETURN(jp->value);
+}
+
+static void c_pull_depth(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_pull *jp = (struct json_pull *)v[0].instance->data;
+
+    SET_INT_RETURN(jp->depth);
+}
+
+static void c_pull_done_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct json_pull *jp = (struct json_pull *)v[0].instance->data;
+
+    SET_BOOL_RETURN(jp->state == PULL_DONE);
+}
+
+/**
+ * Initialize the JSON extension
+ */
+void mrbc_json_init(void)
+{
+    mrbc_class *json = mrbc_define_module(0, "JSON");
+
+    parser_error_class = mrbc_define_class_under(0, json, "ParserError",
+                                                 MRBC_CLASS(StandardError));
+    generator_error_class = mrbc_define_class_under(0, json, "GeneratorError",
+                                                    MRBC_CLASS(StandardError));
+
+    mrbc_define_method(0, json, "parse", c_json_parse);
+    mrbc_define_method(0, json, "generate", c_json_generate);
+    mrbc_define_method(0, json, "dump", c_json_generate);
+
+    pull_parser_class = mrbc_define_class_under(0, json, "PullParser", mrbc_class_object);
+    mrbc_define_destructor(pull_parser_class, pull_free);
+    mrbc_define_method(0, pull_parser_class, "new", c_pull_new);
+    mrbc_define_method(0, pull_parser_class, "<<", c_pull_feed);
+    mrbc_define_method(0, pull_parser_class, "finish", c_pull_finish);
+    mrbc_define_method(0, pull_parser_class, "next", c_pull_next);
+    mrbc_define_method(0, pull_parser_class, "value", c_pull_value);
+    mrbc_define_method(0, pull_parser_class, "depth", c_pull_depth);
+    mrbc_define_method(0, pull_parser_class, "done?", c_pull_done_p);
+
+    sym_symbolize_names = mrbc_str_to_symid("symbolize_names");
+    sym_start_object = mrbc_str_to_symid("start_object");
+    sym_end_object = mrbc_str_to_symid("end_object");
+    sym_start_array = mrbc_str_to_symid("start_array");
+    sym_end_array = mrbc_str_to_symid("end_array");
+    sym_key = mrbc_str_to_symid("key");
+    sym_value = mrbc_str_to_symid("value");
+
+    LOG_DBG("JSON registered");
+}
+
+HAKO_EXTENSION_DEFINE(json, mrbc_json_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
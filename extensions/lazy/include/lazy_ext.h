@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file lazy_ext.h
+ * @brief Lazy extension public API
+ */
+
+#ifndef LAZY_EXT_H
+#define LAZY_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the Lazy extension
+ *
+ * Defines Enumerator::Lazy with its Array, Range, String line and
+ * packed String sources, and queues lib/lazy.rb to run before the
+ * application. Called automatically by HAKO loader during
+ * initialization.
+ */
+void mrbc_lazy_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LAZY_EXT_H */
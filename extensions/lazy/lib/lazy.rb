@@ -0,0 +1,143 @@
+# SPDX-License-Identifier: Apache-2.0
+# Enumerator::Lazy stages for the Lazy extension
+
+class Enumerator
+  class Lazy
+    # Each stage returns a new Lazy with one more entry in @stages;
+    # nothing runs until the chain is forced
+
+    def map(&block)
+      __stage(:map, block)
+    end
+
+    def collect(&block)
+      __stage(:map, block)
+    end
+
+    def select(&block)
+      __stage(:select, block)
+    end
+
+    def filter(&block)
+      __stage(:select, block)
+    end
+
+    def reject(&block)
+      __stage(:reject, block)
+    end
+
+    def filter_map(&block)
+      __stage(:filter_map, block)
+    end
+
+    def take_while(&block)
+      __stage(:take_while, block)
+    end
+
+    def drop_while(&block)
+      __stage(:drop_while, block)
+    end
+
+    def take(n)
+      raise ArgumentError, "attempt to take negative size" if n < 0
+      __stage(:take, n)
+    end
+
+    def drop(n)
+      raise ArgumentError, "attempt to drop negative size" if n < 0
+      __stage(:drop, n)
+    end
+
+    def lazy
+      self
+    end
+
+    # The fused loop: every element goes through all the stages before
+    # the next one is read from the source, so no stage builds an Array
+    def each
+      stages = @stages || []
+      n = stages.size
+      state = Array.new(n, 0)     # take/drop counts, drop_while done
+
+      i = 0
+      while i < n
+        return self if stages[i][0] == :take && stages[i][1] == 0
+        i += 1
+      end
+
+      __rewind
+      stop = false
+      while !stop && !__done?
+        x = __next
+        i = 0
+        while i < n
+          stage = stages[i]
+          op = stage[0]
+          if op == :map
+            x = stage[1].call(x)
+          elsif op == :select
+            break unless stage[1].call(x)
+          elsif op == :reject
+            break if stage[1].call(x)
+          elsif op == :filter_map
+            x = stage[1].call(x)
+            break unless x
+          elsif op == :take_while
+            unless stage[1].call(x)
+              stop = true
+              break
+            end
+          elsif op == :drop_while
+            if state[i] == 0
+              break if stage[1].call(x)
+              state[i] = 1
+            end
+          elsif op == :take
+            # stop after this element, not on reading the next one
+            state[i] += 1
+            stop = true if state[i] >= stage[1]
+          else
+            if state[i] < stage[1]
+              state[i] += 1
+              break
+            end
+          end
+          i += 1
+        end
+        yield x if i == n
+      end
+      self
+    end
+
+    def to_a
+      out = []
+      each { |x| out << x }
+      out
+    end
+
+    def force
+      to_a
+    end
+
+    def first(n = nil)
+      return take(n).to_a if n
+      take(1).to_a[0]
+    end
+
+    def sum(init = 0)
+      total = init
+      each { |x| total += x }
+      total
+    end
+
+    def __stage(op, arg)
+      lazy = __derive
+      lazy.__stages = (@stages || []) + [[op, arg]]
+      lazy
+    end
+
+    def __stages=(stages)
+      @stages = stages
+    end
+  end
+end
@@ -0,0 +1,321 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file lazy.c
+ * @brief Enumerator::Lazy sources: Array, Range, String lines and
+ *        packed Strings, read one element at a time
+ *
+ * A Lazy holds its source and a cursor. __next returns the element at
+ * the cursor and advances it, so the fused loop in lib/lazy.rb never
+ * sees more than one element: a Range is not expanded, a String is not
+ * split into lines and a packed String is not unpacked into an Array.
+ */
+
+#include <hako/extension.h>
+#include <hako/loader.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <string.h>
+
+#include "lazy_ext.h"
+
+#ifdef HAKO_LAZY_RUBY
+#include "lazy_registry.h"
+#endif
+
+LOG_MODULE_REGISTER(hako_lazy, CONFIG_HAKO_LOG_LEVEL);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LAZY_NATIVE_BIG 1
+#else
+#define LAZY_NATIVE_BIG 0
+#endif
+
+enum lazy_kind {
+    LAZY_ARRAY,
+    LAZY_RANGE,
+    LAZY_LINES,
+    LAZY_PACKED,
+};
+
+/* One fixed-size value of a packed String */
+struct packed_type {
+    char directive;
+    uint8_t size;
+    uint8_t big_endian;
+    uint8_t is_signed;
+    uint8_t is_float;
+};
+
+static const struct packed_type packed_types[] = {
+    { 'C', 1, 0, 0, 0 },
+    { 'c', 1, 0, 1, 0 },
+    { 'S', 2, LAZY_NATIVE_BIG, 0, 0 },
+    { 's', 2, LAZY_NATIVE_BIG, 1, 0 },
+    { 'n', 2, 1, 0, 0 },
+    { 'v', 2, 0, 0, 0 },
+    { 'L', 4, LAZY_NATIVE_BIG, 0, 0 },
+    { 'l', 4, LAZY_NATIVE_BIG, 1, 0 },
+    { 'N', 4, 1, 0, 0 },
+    { 'V', 4, 0, 0, 0 },
+#if MRBC_USE_FLOAT
+    { 'e', 4, 0, 0, 1 },
+    { 'g', 4, 1, 0, 1 },
+    { 'E', 8, 0, 0, 1 },
+    { 'G', 8, 1, 0, 1 },
+#endif
+};
+
+struct lazy_source {
+    mrbc_value src;                     /* Array or String; nil for a Range */
+    uint8_t kind;
+    const struct packed_type *type;     /* LAZY_PACKED */
+    mrbc_int_t first;                   /* LAZY_RANGE: first value */
+    mrbc_int_t last;                    /* LAZY_RANGE: last value, inclusive */
+    mrbc_int_t pos;                     /* next index, value or byte offset */
+};
+
+static mrbc_class *lazy_class;
+
+static void lazy_free(mrbc_value *self)
+{
+    struct lazy_source *ls = (struct lazy_source *)self->instance->data;
+
+    mrbc_decref(&ls->src);
+}
+
+static mrbc_value lazy_new(mrbc_vm *vm, const mrbc_value *src, enum lazy_kind kind)
+{
+    mrbc_value obj = mrbc_instance_new(vm, lazy_class, sizeof(struct lazy_source));
+    if (obj.tt != MRBC_TT_OBJECT) {
+        return obj;
+    }
+
+    struct lazy_source *ls = (struct lazy_source *)obj.instance->data;
+    memset(ls, 0, sizeof(*ls));
+    ls->src = *src;
+    mrbc_incref(&ls->src);
+    ls->kind = kind;
+    return obj;
+}
+
+static const struct packed_type *packed_type_find(char directive)
+{
+    for (int i = 0; i < ARRAY_SIZE(packed_types); i++) {
+        if (packed_types[i].directive == directive) {
+            return &packed_types[i];
+        }
+    }
+    return NULL;
+}
+
+static mrbc_value packed_element(mrbc_vm *vm, const struct packed_type *t, const uint8_t *p)
+{
+    uint64_t x = 0;
+
+    for (int i = 0; i < t->size; i++) {
+        x = (x << 8) | p[t->big_endian ? i : t->size - 1 - i];
+    }
+
+#if MRBC_USE_FLOAT
+    if (t->is_float) {
+        if (t->size == 4) {
+            uint32_t u = (uint32_t)x;
+            float f;
+            memcpy(&f, &u, 4);
+            return mrbc_float_value(vm, f);
+        }
+        double d;
+        memcpy(&d, &x, 8);
+        return mrbc_float_value(vm, d);
+    }
+#endif
+
+    if (t->is_signed && (x & (1ULL << (t->size * 8 - 1)))) {
+        x |= ~0ULL << (t->size * 8);
+    }
+    return mrbc_integer_value((mrbc_int_t)(int64_t)x);
+}
+
+/*
+ * Sources
+ */
+
+/* Array#lazy */
+static void c_array_lazy(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    SET_RETURN(lazy_new(vm, &v[0], LAZY_ARRAY));
+}
+
+/* Range#lazy, for Integer ranges */
+static void c_range_lazy(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value *first = &v[0].range->first;
+    mrbc_value *last = &v[0].range->last;
+
+    if (first->tt != MRBC_TT_INTEGER || last->tt != MRBC_TT_INTEGER) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "lazy needs an Integer range");
+        return;
+    }
+
+    mrbc_value nil = mrbc_nil_value();
+    mrbc_value obj = lazy_new(vm, &nil, LAZY_RANGE);
+    if (obj.tt != MRBC_TT_OBJECT) {
+        return;
+    }
+
+    struct lazy_source *ls = (struct lazy_source *)obj.instance->data;
+    ls->first = first->i;
+    ls->last = last->i - (v[0].range->flag_exclude ? 1 : 0);
+    ls->pos = ls->first;
+    SET_RETURN(obj);
+}
+
+/* String#lazy_lines: each line, with its "\n", as each_line gives it */
+static void c_string_lazy_lines(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    SET_RETURN(lazy_new(vm, &v[0], LAZY_LINES));
+}
+
+/* String#lazy_unpack(directive): one fixed-size value at a time */
+static void c_string_lazy_unpack(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING || v[1].string->size != 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "one unpack directive expected");
+        return;
+    }
+
+    char directive = v[1].string->data[0];
+    const struct packed_type *type = packed_type_find(directive);
+    if (!type) {
+        mrbc_raisef(vm, MRBC_CLASS(ArgumentError), "unsupported directive '%c'", directive);
+        return;
+    }
+
+    mrbc_value obj = lazy_new(vm, &v[0], LAZY_PACKED);
+    if (obj.tt != MRBC_TT_OBJECT) {
+        return;
+    }
+
+    struct lazy_source *ls = (struct lazy_source *)obj.instance->data;
+    ls->type = type;
+    SET_RETURN(obj);
+}
+
+/*
+ * Cursor
+ */
+
+static int lazy_done(const struct lazy_source *ls)
+{
+    switch (ls->kind) {
+    case LAZY_ARRAY:
+        return ls->pos >= ls->src.array->n_stored;
+    case LAZY_RANGE:
+        return ls->pos > ls->last;
+    case LAZY_LINES:
+        return ls->pos >= ls->src.string->size;
+    default:
+        return ls->pos + ls->type->size > ls->src.string->size;
+    }
+}
+
+static void c_lazy_done_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    SET_BOOL_RETURN(lazy_done((struct lazy_source *)v[0].instance->data));
+}
+
+/* The element at the cursor, moving past it; nil at the end */
+static void c_lazy_next(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct lazy_source *ls = (struct lazy_source *)v[0].instance->data;
+
+    if (lazy_done(ls)) {
+        SET_NIL_RETURN();
+        return;
+    }
+
+    switch (ls->kind) {
+    case LAZY_ARRAY: {
+        mrbc_value x = ls->src.array->data[ls->pos++];
+        mrbc_incref(&x);
+        SET_RETURN(x);
+        break;
+    }
+    case LAZY_RANGE:
+        SET_INT_RETURN(ls->pos++);
+        break;
+    case LAZY_LINES: {
+        const uint8_t *p = ls->src.string->data + ls->pos;
+        int rest = ls->src.string->size - ls->pos;
+        const uint8_t *nl = memchr(p, '\n', rest);
+        int len = nl ? (nl - p) + 1 : rest;
+        ls->pos += len;
+        SET_RETURN(mrbc_string_new(vm, p, len));
+        break;
+    }
+    default: {
+        const uint8_t *p = ls->src.string->data + ls->pos;
+        ls->pos += ls->type->size;
+        SET_RETURN(packed_element(vm, ls->type, p));
+        break;
+    }
+    }
+}
+
+static void c_lazy_rewind(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct lazy_source *ls = (struct lazy_source *)v[0].instance->data;
+
+    ls->pos = (ls->kind == LAZY_RANGE) ? ls->first : 0;
+}
+
+/* A new Lazy over the same source, for the next stage of a chain */
+static void c_lazy_derive(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct lazy_source *ls = (struct lazy_source *)v[0].instance->data;
+    mrbc_value obj = lazy_new(vm, &ls->src, ls->kind);
+    if (obj.tt != MRBC_TT_OBJECT) {
+        return;
+    }
+
+    struct lazy_source *copy = (struct lazy_source *)obj.instance->data;
+    mrbc_value src = copy->src;
+    *copy = *ls;
+    copy->src = src;
+    SET_RETURN(obj);
+}
+
+/**
+ * Initialize the Lazy extension
+ */
+void mrbc_lazy_init(void)
+{
+    mrbc_class *enumerator = mrbc_define_class(0, "Enumerator", mrbc_class_object);
+
+    lazy_class = mrbc_define_class_under(0, enumerator, "Lazy", mrbc_class_object);
+    mrbc_define_destructor(lazy_class, lazy_free);
+    mrbc_define_method(0, lazy_class, "__next", c_lazy_next);
+    mrbc_define_method(0, lazy_class, "__done?", c_lazy_done_p);
+    mrbc_define_method(0, lazy_class, "__rewind", c_lazy_rewind);
+    mrbc_define_method(0, lazy_class, "__derive", c_lazy_derive);
+
+    mrbc_define_method(0, MRBC_CLASS(Array), "lazy", c_array_lazy);
+    mrbc_define_method(0, MRBC_CLASS(Range), "lazy", c_range_lazy);
+    mrbc_define_method(0, MRBC_CLASS(String), "lazy_lines", c_string_lazy_lines);
+    mrbc_define_method(0, MRBC_CLASS(String), "lazy_unpack", c_string_lazy_unpack);
+
+#ifdef HAKO_LAZY_RUBY
+    /* defines the stages and the loop that runs them */
+    if (hako_load_library("lazy", hako_lazy_registry[0].bytecode) < 0) {
+        LOG_ERR("Failed to load lazy.rb");
+    }
+#else
+    LOG_WRN("lazy.rb not compiled; Enumerator::Lazy has no stages");
+#endif
+
+    LOG_DBG("Lazy registered");
+}
+
+HAKO_EXTENSION_DEFINE(lazy, mrbc_lazy_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file msgpack_ext.h
+ * @brief MessagePack extension public API
+ */
+
+#ifndef MSGPACK_EXT_H
+#define MSGPACK_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the MessagePack extension
+ *
+ * Registers the MessagePack module and MessagePack::UnpackError with
+ * the mruby/c VM. Called automatically by HAKO loader during
+ * initialization.
+ */
+void mrbc_msgpack_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MSGPACK_EXT_H */
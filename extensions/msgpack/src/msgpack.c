@@ -0,0 +1,517 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file msgpack.c
+ * @brief MessagePack.pack and MessagePack.unpack
+ *
+ * pack measures the encoded size first, then writes into a single String
+ * of exactly that size. unpack reads the element counts from the input
+ * and allocates Arrays and Hashes at that size up to a small cap, so a
+ * forged count cannot ask for more than the input can fill. Each string
+ * is copied once straight from the source.
+ */
+
+#include <hako/extension.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <string.h>
+
+#include "msgpack_ext.h"
+
+LOG_MODULE_REGISTER(hako_msgpack, CONFIG_HAKO_LOG_LEVEL);
+
+/* Elements allocated up front; larger Arrays and Hashes grow as they fill */
+#define UNPACK_PREALLOC_MAX 16
+
+static mrbc_class *unpack_error_class;
+
+/*
+ * MessagePack.pack
+ */
+
+struct mp_pack {
+    mrbc_vm *vm;
+    uint8_t *buf;       /* NULL while measuring */
+    uint32_t len;
+};
+
+static void put_bytes(struct mp_pack *pk, const void *p, uint32_t n)
+{
+    if (pk->buf) {
+        memcpy(pk->buf + pk->len, p, n);
+    }
+    pk->len += n;
+}
+
+static void put_byte(struct mp_pack *pk, uint8_t b)
+{
+    put_bytes(pk, &b, 1);
+}
+
+/* A type byte followed by n big-endian bytes of v */
+static void put_be(struct mp_pack *pk, uint8_t type, uint64_t v, int n)
+{
+    uint8_t b[9];
+
+    b[0] = type;
+    for (int i = n; i > 0; i--) {
+        b[i] = (uint8_t)v;
+        v >>= 8;
+    }
+    put_bytes(pk, b, n + 1);
+}
+
+static void pack_int(struct mp_pack *pk, int64_t v)
+{
+    if (v >= 0) {
+        if (v < 0x80) {
+            put_byte(pk, (uint8_t)v);
+        } else if (v <= 0xff) {
+            put_be(pk, 0xcc, v, 1);
+        } else if (v <= 0xffff) {
+            put_be(pk, 0xcd, v, 2);
+        } else if (v <= 0xffffffff) {
+            put_be(pk, 0xce, v, 4);
+        } else {
+            put_be(pk, 0xcf, v, 8);
+        }
+    } else {
+        if (v >= -32) {
+            put_byte(pk, (uint8_t)v);
+        } else if (v >= INT8_MIN) {
+            put_be(pk, 0xd0, v, 1);
+        } else if (v >= INT16_MIN) {
+            put_be(pk, 0xd1, v, 2);
+        } else if (v >= INT32_MIN) {
+            put_be(pk, 0xd2, v, 4);
+        } else {
+            put_be(pk, 0xd3, v, 8);
+        }
+    }
+}
+
+/* Length header: the fix form up to fix_max, then the 16- and 32-bit forms */
+static void pack_header(struct mp_pack *pk, uint8_t fix, uint32_t fix_max, uint8_t type16, uint32_t n)
+{
+    if (n <= fix_max) {
+        put_byte(pk, fix | n);
+    } else if (n <= 0xffff) {
+        put_be(pk, type16, n, 2);
+    } else {
+        put_be(pk, type16 + 1, n, 4);
+    }
+}
+
+static void pack_str(struct mp_pack *pk, const void *p, uint32_t n)
+{
+    if (n > 31 && n <= 0xff) {
+        put_be(pk, 0xd9, n, 1);
+    } else {
+        pack_header(pk, 0xa0, 31, 0xda, n);
+    }
+    put_bytes(pk, p, n);
+}
+
+static int pack_value(struct mp_pack *pk, mrbc_value *v, int depth)
+{
+    switch (v->tt) {
+    case MRBC_TT_NIL:
+        put_byte(pk, 0xc0);
+        return 0;
+    case MRBC_TT_FALSE:
+        put_byte(pk, 0xc2);
+        return 0;
+    case MRBC_TT_TRUE:
+        put_byte(pk, 0xc3);
+        return 0;
+    case MRBC_TT_INTEGER:
+        pack_int(pk, v->i);
+        return 0;
+#if MRBC_USE_FLOAT
+    case MRBC_TT_FLOAT: {
+        /* always float 64, as msgpack-ruby does */
+        union {
+            double d;
+            uint64_t u;
+        } f = { .d = v->d };
+        put_be(pk, 0xcb, f.u, 8);
+        return 0;
+    }
+#endif
+    case MRBC_TT_STRING:
+        pack_str(pk, v->string->data, v->string->size);
+        return 0;
+    case MRBC_TT_SYMBOL: {
+        const char *name = mrbc_symid_to_str(v->sym_id);
+        pack_str(pk, name, strlen(name));
+        return 0;
+    }
+    case MRBC_TT_ARRAY:
+    case MRBC_TT_HASH:
+        break;
+    default:
+        mrbc_raise(pk->vm, MRBC_CLASS(TypeError), "only nil, true, false, numbers, Strings, Symbols, Arrays and Hashes can be packed");
+        return -1;
+    }
+
+    if (depth >= CONFIG_HAKO_MSGPACK_MAX_DEPTH) {
+        mrbc_raise(pk->vm, MRBC_CLASS(ArgumentError), "nesting too deep");
+        return -1;
+    }
+
+    if (v->tt == MRBC_TT_ARRAY) {
+        pack_header(pk, 0x90, 15, 0xdc, v->array->n_stored);
+        for (int i = 0; i < v->array->n_stored; i++) {
+            if (pack_value(pk, &v->array->data[i], depth + 1) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    mrbc_hash_iterator ite = mrbc_hash_iterator_new(v);
+
+    pack_header(pk, 0x80, 15, 0xde, mrbc_hash_size(v));
+    while (mrbc_hash_i_has_next(&ite)) {
+        mrbc_value *kv = mrbc_hash_i_next(&ite);
+        if (pack_value(pk, &kv[0], depth + 1) < 0 ||
+            pack_value(pk, &kv[1], depth + 1) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void c_msgpack_pack(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct mp_pack pk = { .vm = vm };
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+
+    /* measure, then write into a String of exactly that size */
+    if (pack_value(&pk, &v[1], 0) < 0) {
+        return;
+    }
+
+    mrbc_value str = mrbc_string_new(vm, NULL, pk.len);
+    if (str.tt != MRBC_TT_STRING || !str.string) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+    pk.buf = str.string->data;
+    pk.len = 0;
+    pack_value(&pk, &v[1], 0);
+    pk.buf[pk.len] = '\0';
+    SET_RETURN(str);
+}
+
+/*
+ * MessagePack.unpack
+ */
+
+struct mp_unpack {
+    mrbc_vm *vm;
+    const uint8_t *start;
+    const uint8_t *p;
+    const uint8_t *end;
+};
+
+static int unpack_error(struct mp_unpack *up, const char *msg)
+{
+    mrbc_raisef(up->vm, unpack_error_class, "%s at offset %d", msg, (int)(up->p - up->start));
+    return -1;
+}
+
+/* Read an n-byte big-endian unsigned value, or fail on truncated input */
+static int get_be(struct mp_unpack *up, int n, uint64_t *out)
+{
+    uint64_t v = 0;
+
+    if (up->end - up->p < n) {
+        return unpack_error(up, "unexpected end of data");
+    }
+    for (int i = 0; i < n; i++) {
+        v = (v << 8) | *up->p++;
+    }
+    *out = v;
+    return 0;
+}
+
+static int unpack_nomem(struct mp_unpack *up)
+{
+    mrbc_raise(up->vm, MRBC_CLASS(NoMemoryError), "out of memory");
+    return -1;
+}
+
+static int unpack_value(struct mp_unpack *up, mrbc_value *out, int depth);
+
+static int unpack_str(struct mp_unpack *up, uint32_t n, mrbc_value *out)
+{
+    if ((uint32_t)(up->end - up->p) < n) {
+        return unpack_error(up, "unexpected end of data");
+    }
+    *out = mrbc_string_new(up->vm, up->p, n);
+    if (out->tt != MRBC_TT_STRING || !out->string) {
+        return unpack_nomem(up);
+    }
+    up->p += n;
+    return 0;
+}
+
+static int unpack_array(struct mp_unpack *up, uint32_t n, mrbc_value *out, int depth)
+{
+    if (depth >= CONFIG_HAKO_MSGPACK_MAX_DEPTH) {
+        return unpack_error(up, "nesting too deep");
+    }
+    /* every element takes at least one byte, so n cannot exceed the rest */
+    if ((uint32_t)(up->end - up->p) < n) {
+        return unpack_error(up, "unexpected end of data");
+    }
+
+    mrbc_value ary = mrbc_array_new(up->vm, MIN(n, UNPACK_PREALLOC_MAX));
+    if (ary.tt != MRBC_TT_ARRAY || !ary.array) {
+        return unpack_nomem(up);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        mrbc_value item;
+        if (unpack_value(up, &item, depth + 1) < 0) {
+            mrbc_decref(&ary);
+            return -1;
+        }
+        if (mrbc_array_push(&ary, &item) != 0) {
+            mrbc_decref(&item);
+            mrbc_decref(&ary);
+            return unpack_nomem(up);
+        }
+    }
+    *out = ary;
+    return 0;
+}
+
+static int unpack_map(struct mp_unpack *up, uint32_t n, mrbc_value *out, int depth)
+{
+    if (depth >= CONFIG_HAKO_MSGPACK_MAX_DEPTH) {
+        return unpack_error(up, "nesting too deep");
+    }
+    if ((uint32_t)(up->end - up->p) / 2 < n) {
+        return unpack_error(up, "unexpected end of data");
+    }
+
+    mrbc_value hash = mrbc_hash_new(up->vm, MIN(n, UNPACK_PREALLOC_MAX));
+    if (hash.tt != MRBC_TT_HASH || !hash.hash) {
+        return unpack_nomem(up);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        mrbc_value key;
+        mrbc_value val;
+        if (unpack_value(up, &key, depth + 1) < 0) {
+            mrbc_decref(&hash);
+            return -1;
+        }
+        if (unpack_value(up, &val, depth + 1) < 0) {
+            mrbc_decref(&key);
+            mrbc_decref(&hash);
+            return -1;
+        }
+        if (mrbc_hash_set(&hash, &key, &val) != 0) {
+            mrbc_decref(&key);
+            mrbc_decref(&val);
+            mrbc_decref(&hash);
+            return unpack_nomem(up);
+        }
+    }
+    *out = hash;
+    return 0;
+}
+
+static int unpack_uint(struct mp_unpack *up, uint64_t u, mrbc_value *out)
+{
+    if (u > (uint64_t)((~(mrbc_uint_t)0) >> 1)) {
+        return unpack_error(up, "integer too big");
+    }
+    *out = mrbc_integer_value((mrbc_int_t)u);
+    return 0;
+}
+
+static int unpack_sint(struct mp_unpack *up, int64_t i, mrbc_value *out)
+{
+    if ((mrbc_int_t)i != i) {
+        return unpack_error(up, "integer too big");
+    }
+    *out = mrbc_integer_value((mrbc_int_t)i);
+    return 0;
+}
+
+static int unpack_value(struct mp_unpack *up, mrbc_value *out, int depth)
+{
+    uint64_t u;
+
+    if (up->p >= up->end) {
+        return unpack_error(up, "unexpected end of data");
+    }
+
+    uint8_t b = *up->p++;
+
+    /* fixint, fixmap, fixarray, fixstr */
+    if (b <= 0x7f) {
+        *out = mrbc_integer_value(b);
+        return 0;
+    }
+    if (b >= 0xe0) {
+        *out = mrbc_integer_value((int8_t)b);
+        return 0;
+    }
+    if (b >= 0xa0 && b <= 0xbf) {
+        return unpack_str(up, b & 0x1f, out);
+    }
+    if (b <= 0x8f) {
+        return unpack_map(up, b & 0x0f, out, depth);
+    }
+    if (b <= 0x9f) {
+        return unpack_array(up, b & 0x0f, out, depth);
+    }
+
+    switch (b) {
+    case 0xc0:
+        *out = mrbc_nil_value();
+        return 0;
+    case 0xc2:
+        *out = mrbc_false_value();
+        return 0;
+    case 0xc3:
+        *out = mrbc_true_value();
+        return 0;
+
+    case 0xcc: case 0xcd: case 0xce: case 0xcf:
+        if (get_be(up, 1 << (b - 0xcc), &u) < 0) {
+            return -1;
+        }
+        return unpack_uint(up, u, out);
+    case 0xd0:
+        if (get_be(up, 1, &u) < 0) {
+            return -1;
+        }
+        return unpack_sint(up, (int8_t)u, out);
+    case 0xd1:
+        if (get_be(up, 2, &u) < 0) {
+            return -1;
+        }
+        return unpack_sint(up, (int16_t)u, out);
+    case 0xd2:
+        if (get_be(up, 4, &u) < 0) {
+            return -1;
+        }
+        return unpack_sint(up, (int32_t)u, out);
+    case 0xd3:
+        if (get_be(up, 8, &u) < 0) {
+            return -1;
+        }
+        return unpack_sint(up, (int64_t)u, out);
+
+    case 0xca:
+    case 0xcb:
+#if MRBC_USE_FLOAT
+        if (b == 0xca) {
+            union {
+                float f;
+                uint32_t u;
+            } f;
+            if (get_be(up, 4, &u) < 0) {
+                return -1;
+            }
+            f.u = (uint32_t)u;
+            *out = mrbc_float_value(up->vm, f.f);
+        } else {
+            union {
+                double d;
+                uint64_t u;
+            } d;
+            if (get_be(up, 8, &u) < 0) {
+                return -1;
+            }
+            d.u = u;
+            *out = mrbc_float_value(up->vm, d.d);
+        }
+        return 0;
+#else
+        up->p--;
+        return unpack_error(up, "floats are not supported");
+#endif
+
+    /* str and bin both become Strings */
+    case 0xd9: case 0xda: case 0xdb:
+        if (get_be(up, 1 << (b - 0xd9), &u) < 0) {
+            return -1;
+        }
+        return unpack_str(up, (uint32_t)u, out);
+    case 0xc4: case 0xc5: case 0xc6:
+        if (get_be(up, 1 << (b - 0xc4), &u) < 0) {
+            return -1;
+        }
+        return unpack_str(up, (uint32_t)u, out);
+
+    case 0xdc: case 0xdd:
+        if (get_be(up, 2 << (b - 0xdc), &u) < 0) {
+            return -1;
+        }
+        return unpack_array(up, (uint32_t)u, out, depth);
+    case 0xde: case 0xdf:
+        if (get_be(up, 2 << (b - 0xde), &u) < 0) {
+            return -1;
+        }
+        return unpack_map(up, (uint32_t)u, out, depth);
+
+    default:
+        /* 0xc1 and the ext types */
+        up->p--;
+        return unpack_error(up, "unsupported type");
+    }
+}
+
+static void c_msgpack_unpack(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    struct mp_unpack up = {
+        .vm = vm,
+        .start = v[1].string->data,
+        .p = v[1].string->data,
+        .end = v[1].string->data + v[1].string->size,
+    };
+    mrbc_value result;
+
+    if (unpack_value(&up, &result, 0) < 0) {
+        return;
+    }
+    if (up.p != up.end) {
+        mrbc_decref(&result);
+        unpack_error(&up, "extra bytes after data");
+        return;
+    }
+    SET_RETURN(result);
+}
+
+/**
+ * Initialize the MessagePack extension
+ */
+void mrbc_msgpack_init(void)
+{
+    mrbc_class *msgpack = mrbc_define_module(0, "MessagePack");
+
+    unpack_error_class = mrbc_define_class_under(0, msgpack, "UnpackError",
+                                                 MRBC_CLASS(StandardError));
+
+    mrbc_define_method(0, msgpack, "pack", c_msgpack_pack);
+    mrbc_define_method(0, msgpack, "unpack", c_msgpack_unpack);
+
+    LOG_DBG("MessagePack registered");
+}
+
+HAKO_EXTENSION_DEFINE(msgpack, mrbc_msgpack_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file hako_number.h
+ * @brief Number formatting and parsing
+ *
+ * Integers are written two digits at a time from a table of pairs.
+ * Floats are written in their shortest round-trip form: candidates of
+ * up to 15 digits are checked exactly with one IEEE multiply or divide
+ * by an exact power of ten, and only values needing 16 or 17 digits go
+ * through snprintf() and strtod(). Parsing reads eight digits at a
+ * time (SWAR) and builds a Float from at most 15 digits with one exact
+ * operation, falling back to strtod() beyond that.
+ */
+
+#ifndef HAKO_NUMBER_H
+#define HAKO_NUMBER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Buffer size for hako_number_itoa() */
+#define HAKO_NUMBER_INT_MAX 24
+
+/** Buffer size for hako_number_dtoa() */
+#define HAKO_NUMBER_FLOAT_MAX 32
+
+/**
+ * @brief Write x in base 10
+ *
+ * @param buf At least HAKO_NUMBER_INT_MAX bytes; not NUL-terminated
+ * @param x Value
+ * @return Number of bytes written
+ */
+int hako_number_itoa(char *buf, int64_t x);
+
+/**
+ * @brief Write d as CRuby's Float#to_s does
+ *
+ * The shortest digits that read back as d, in fixed notation from 1e-4
+ * up to 1e16 ("0.0001", "12.5", "100.0") and as "1.0e+16" outside it;
+ * "Infinity", "-Infinity" and "NaN" otherwise.
+ *
+ * @param buf At least HAKO_NUMBER_FLOAT_MAX bytes; not NUL-terminated
+ * @param d Value
+ * @return Number of bytes written
+ */
+int hako_number_dtoa(char *buf, double d);
+
+/**
+ * @brief Write the digits of |d| rounded to prec decimals, as "%.*f"
+ *
+ * Only the fast case is handled: |d| * 10^prec must be below 2^53 and
+ * not within rounding error of a half.
+ *
+ * @param buf At least HAKO_NUMBER_INT_MAX + 1 bytes; not NUL-terminated
+ * @param d Finite value; its sign is ignored
+ * @param prec Decimals, 0 to 22
+ * @return Number of bytes written, or -1 if the fast case does not apply
+ */
+int hako_number_fixed(char *buf, double d, int prec);
+
+/**
+ * @brief Parse the base 10 Integer at the start of p, as String#to_i
+ *
+ * Leading whitespace, a sign, and single underscores between digits
+ * are accepted; parsing stops at the first other byte. Values too
+ * large for int64_t wrap.
+ *
+ * @return The value, 0 if there are no digits
+ */
+int64_t hako_number_atoi(const uint8_t *p, int len);
+
+/**
+ * @brief Parse the Float at the start of p, as String#to_f
+ *
+ * @return The value, 0.0 if there is no number
+ */
+double hako_number_atof(const uint8_t *p, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAKO_NUMBER_H */
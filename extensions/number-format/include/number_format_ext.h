@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file number_format_ext.h
+ * @brief Number format extension public API
+ */
+
+#ifndef NUMBER_FORMAT_EXT_H
+#define NUMBER_FORMAT_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the number format extension
+ *
+ * Replaces Integer#to_s, Float#to_s, String#to_i, String#to_f,
+ * sprintf and format, and defines String#%. Called automatically by
+ * HAKO loader during initialization.
+ */
+void mrbc_number_format_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NUMBER_FORMAT_EXT_H */
@@ -0,0 +1,521 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file number.c
+ * @brief Integer and Float to text and back
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hako_number.h"
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define NUMBER_NATIVE_BIG 1
+#else
+#define NUMBER_NATIVE_BIG 0
+#endif
+
+/* 2^53: integers below it are exact in a double */
+#define EXACT_INT_MAX 9007199254740992.0
+
+/* Significant digits kept while parsing; 19 always fit in a uint64_t */
+#define PARSE_DIGITS_MAX 19
+
+/* Longest number text handed to strtod() */
+#define PARSE_TEXT_MAX 128
+
+static const char digit_pairs[200] = {
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899"
+};
+
+/* Powers of ten that are exact in a double */
+static const double pow10_exact[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define POW10_EXACT_MAX 22
+
+static inline int is_digit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* Whitespace skipped by CRuby's to_i and to_f */
+static inline int is_space(int c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * Integer to text
+ */
+
+/* Digits of x, written backwards so that they end at end */
+static char *utoa_back(char *end, uint64_t x)
+{
+    char *p = end;
+
+    /* 32-bit division is much cheaper than 64-bit on small cores */
+    while (x > UINT32_MAX) {
+        unsigned r = (unsigned)(x % 100);
+        x /= 100;
+        p -= 2;
+        memcpy(p, &digit_pairs[2 * r], 2);
+    }
+
+    uint32_t y = (uint32_t)x;
+    while (y >= 100) {
+        unsigned r = y % 100;
+        y /= 100;
+        p -= 2;
+        memcpy(p, &digit_pairs[2 * r], 2);
+    }
+    if (y >= 10) {
+        p -= 2;
+        memcpy(p, &digit_pairs[2 * y], 2);
+    } else {
+        *--p = '0' + y;
+    }
+    return p;
+}
+
+static int utoa(char *buf, uint64_t x)
+{
+    char tmp[HAKO_NUMBER_INT_MAX];
+    char *end = tmp + sizeof(tmp);
+    char *p = utoa_back(end, x);
+
+    memcpy(buf, p, end - p);
+    return end - p;
+}
+
+int hako_number_itoa(char *buf, int64_t x)
+{
+    if (x < 0) {
+        buf[0] = '-';
+        return 1 + utoa(buf + 1, -(uint64_t)x);
+    }
+    return utoa(buf, x);
+}
+
+/*
+ * Float to text
+ */
+
+/* The distance from x to the next double up, for finite x >= 0 */
+static double ulp_of(double x)
+{
+    uint64_t b;
+    double u;
+
+    memcpy(&b, &x, sizeof(b));
+    b &= 0x7ff0000000000000ULL;
+    if (b <= (52ULL << 52)) {
+        return 0x1p-1074;
+    }
+    b -= 52ULL << 52;
+    memcpy(&u, &b, sizeof(u));
+    return u;
+}
+
+/* An estimate of floor(log10(d)) for d > 0, off by at most one */
+static int decimal_exponent(double d)
+{
+    uint64_t b;
+
+    memcpy(&b, &d, sizeof(b));
+    int e2 = (int)((b >> 52) & 0x7ff) - 1023;
+    /* 78913 / 2^18 is log10(2) to six places */
+    int k = (e2 * 78913) >> 18;
+
+    /* the scaling is not exact for k < 0, but close enough to choose */
+    if (k > -POW10_EXACT_MAX && k < POW10_EXACT_MAX) {
+        if ((k + 1 >= 0) ? d >= pow10_exact[k + 1] : d * pow10_exact[-k - 1] >= 1.0) {
+            k++;
+        } else if ((k >= 0) ? d < pow10_exact[k] : d * pow10_exact[-k] < 1.0) {
+            k--;
+        }
+    }
+    return k;
+}
+
+/*
+ * Is c * 10^-s the double d? With c below 2^53 and |s| <= 22 both
+ * operands are exact, so the one rounding gives the nearest double to
+ * the decimal, as strtod() would.
+ */
+static inline int reads_back(uint64_t c, int s, double d)
+{
+    return ((s >= 0) ? (double)c / pow10_exact[s] : (double)c * pow10_exact[-s]) == d;
+}
+
+/*
+ * The shortest digits that read back as d > 0, with decpt set so that
+ * d = 0.DIGITS * 10^decpt. Returns the number of digits.
+ */
+static int shortest(double d, char *digits, int *decpt)
+{
+    int k = decimal_exponent(d);
+
+    for (int p = 1; p <= 17; p++) {
+        int s = p - 1 - k;
+
+        if (p <= 15 && s >= -POW10_EXACT_MAX && s <= POW10_EXACT_MAX) {
+            double x = (s >= 0) ? d * pow10_exact[s] : d / pow10_exact[-s];
+            uint64_t m = (uint64_t)(x + 0.5);
+            uint64_t c;
+
+            /* x is rounded, so its neighbours may be the ones that fit */
+            if (m > 0 && reads_back(m, s, d)) {
+                c = m;
+            } else if (m > 1 && reads_back(m - 1, s, d)) {
+                c = m - 1;
+            } else if (reads_back(m + 1, s, d)) {
+                c = m + 1;
+            } else {
+                continue;
+            }
+
+            int n = utoa(digits, c);
+            *decpt = n - s;
+            while (n > 1 && digits[n - 1] == '0') {
+                n--;
+            }
+            return n;
+        }
+
+        /* 16 or 17 digits, or an exponent with no exact power of ten */
+        char buf[HAKO_NUMBER_FLOAT_MAX];
+        snprintf(buf, sizeof(buf), "%.*e", p - 1, d);
+        if (strtod(buf, NULL) != d) {
+            continue;
+        }
+
+        int n = 0;
+        const char *q = buf;
+        for (; *q != 'e'; q++) {
+            if (*q != '.') {
+                digits[n++] = *q;
+            }
+        }
+        *decpt = atoi(q + 1) + 1;
+        while (n > 1 && digits[n - 1] == '0') {
+            n--;
+        }
+        return n;
+    }
+
+    /* not reached: 17 digits always read back */
+    digits[0] = '0';
+    *decpt = 1;
+    return 1;
+}
+
+int hako_number_dtoa(char *buf, double d)
+{
+    if (d != d) {
+        memcpy(buf, "NaN", 3);
+        return 3;
+    }
+
+    char *p = buf;
+    uint64_t b;
+    memcpy(&b, &d, sizeof(b));
+    if (b >> 63) {
+        *p++ = '-';
+        d = -d;
+    }
+    if (d > 1.7976931348623157e308) {
+        memcpy(p, "Infinity", 8);
+        return p - buf + 8;
+    }
+    if (d == 0) {
+        memcpy(p, "0.0", 3);
+        return p - buf + 3;
+    }
+
+    char digits[20];
+    int decpt;
+    int n = shortest(d, digits, &decpt);
+
+    /* as CRuby's flo_to_s: up to 15 whole digits, or 16 with a fraction */
+    if (decpt > 0 && decpt < n) {
+        memcpy(p, digits, decpt);
+        p[decpt] = '.';
+        memcpy(p + decpt + 1, digits + decpt, n - decpt);
+        p += n + 1;
+    } else if (decpt > 0 && decpt <= 15) {
+        memcpy(p, digits, n);
+        memset(p + n, '0', decpt - n);
+        p += decpt;
+        memcpy(p, ".0", 2);
+        p += 2;
+    } else if (decpt <= 0 && decpt > -4) {
+        memcpy(p, "0.", 2);
+        memset(p + 2, '0', -decpt);
+        p += 2 - decpt;
+        memcpy(p, digits, n);
+        p += n;
+    } else {
+        *p++ = digits[0];
+        *p++ = '.';
+        if (n > 1) {
+            memcpy(p, digits + 1, n - 1);
+            p += n - 1;
+        } else {
+            *p++ = '0';
+        }
+        int e = decpt - 1;
+        *p++ = 'e';
+        *p++ = (e < 0) ? '-' : '+';
+        if (e < 0) {
+            e = -e;
+        }
+        if (e >= 100) {
+            *p++ = '0' + e / 100;
+            e %= 100;
+        }
+        memcpy(p, &digit_pairs[2 * e], 2);
+        p += 2;
+    }
+    return p - buf;
+}
+
+int hako_number_fixed(char *buf, double d, int prec)
+{
+    if (d < 0) {
+        d = -d;
+    }
+    if (prec < 0 || prec > POW10_EXACT_MAX) {
+        return -1;
+    }
+
+    double x = d * pow10_exact[prec];
+    if (!(x < EXACT_INT_MAX)) {
+        return -1;
+    }
+
+    /*
+     * x is within half an ulp of the exact product; if a half lies that
+     * close, which way it rounds needs the exact digits
+     */
+    uint64_t m = (uint64_t)x;
+    double frac = x - (double)m;
+    double ulp = ulp_of(x);
+    if (frac - 0.5 <= ulp && 0.5 - frac <= ulp) {
+        return -1;
+    }
+    if (frac > 0.5) {
+        m++;
+    }
+
+    char tmp[HAKO_NUMBER_INT_MAX + POW10_EXACT_MAX];
+    char *end = tmp + sizeof(tmp);
+    char *p = utoa_back(end, m);
+    while (end - p < prec + 1) {
+        *--p = '0';
+    }
+
+    int whole = end - p - prec;
+    memcpy(buf, p, whole);
+    if (prec == 0) {
+        return whole;
+    }
+    buf[whole] = '.';
+    memcpy(buf + whole + 1, p + whole, prec);
+    return whole + 1 + prec;
+}
+
+/*
+ * Text to number
+ */
+
+/* Eight ASCII digits at p as a number, or -1 if they are not all digits */
+static inline int32_t eight_digits(const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if NUMBER_NATIVE_BIG
+    v = __builtin_bswap64(v);
+#endif
+    if (((v & 0xf0f0f0f0f0f0f0f0ULL) |
+         (((v + 0x0606060606060606ULL) & 0xf0f0f0f0f0f0f0f0ULL) >> 4)) != 0x3333333333333333ULL) {
+        return -1;
+    }
+
+    /* pairs, then fours, then all eight, in three multiplies */
+    v -= 0x3030303030303030ULL;
+    v = (v * 10) + (v >> 8);
+    v = (((v & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+         (((v >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+    return (int32_t)v;
+}
+
+/* Is p[i] an underscore between two digits? */
+static inline int digit_separator(const uint8_t *p, int i, int len)
+{
+    return p[i] == '_' && i > 0 && is_digit(p[i - 1]) && i + 1 < len && is_digit(p[i + 1]);
+}
+
+int64_t hako_number_atoi(const uint8_t *p, int len)
+{
+    int i = 0;
+
+    while (i < len && is_space(p[i])) {
+        i++;
+    }
+
+    int neg = 0;
+    if (i < len && (p[i] == '+' || p[i] == '-')) {
+        neg = (p[i] == '-');
+        i++;
+    }
+
+    uint64_t x = 0;
+    while (i < len) {
+        int32_t eight;
+        if (len - i >= 8 && (eight = eight_digits(p + i)) >= 0) {
+            x = x * 100000000 + eight;
+            i += 8;
+        } else if (is_digit(p[i])) {
+            x = x * 10 + (p[i] - '0');
+            i++;
+        } else if (digit_separator(p, i, len)) {
+            i++;
+        } else {
+            break;
+        }
+    }
+    return neg ? -(int64_t)x : (int64_t)x;
+}
+
+/*
+ * Digits from p[*i] on, with separators, into *w while it has room;
+ * frac counts the digits kept as decimals. Returns the digits read.
+ */
+static int parse_digits(const uint8_t *p, int len, int *i, uint64_t *w, int *nd,
+                        int *exp10, int frac, int *truncated)
+{
+    int start = *i;
+
+    while (*i < len) {
+        int32_t eight;
+        if (*nd + 8 <= PARSE_DIGITS_MAX && *w != 0 && len - *i >= 8 &&
+            (eight = eight_digits(p + *i)) >= 0) {
+            *w = *w * 100000000 + eight;
+            *nd += 8;
+            *exp10 -= frac ? 8 : 0;
+            *i += 8;
+        } else if (is_digit(p[*i])) {
+            int c = p[*i] - '0';
+            if (*w == 0 && c == 0) {
+                /* leading zeros are not significant */
+                *exp10 -= frac ? 1 : 0;
+            } else if (*nd < PARSE_DIGITS_MAX) {
+                *w = *w * 10 + c;
+                (*nd)++;
+                *exp10 -= frac ? 1 : 0;
+            } else {
+                *exp10 += frac ? 0 : 1;
+                *truncated |= (c != 0);
+            }
+            (*i)++;
+        } else if (digit_separator(p, *i, len)) {
+            (*i)++;
+        } else {
+            break;
+        }
+    }
+    return *i - start;
+}
+
+double hako_number_atof(const uint8_t *p, int len)
+{
+    int i = 0;
+
+    while (i < len && is_space(p[i])) {
+        i++;
+    }
+
+    int start = i;
+    int neg = 0;
+    if (i < len && (p[i] == '+' || p[i] == '-')) {
+        neg = (p[i] == '-');
+        i++;
+    }
+
+    uint64_t w = 0;
+    int nd = 0;
+    int exp10 = 0;
+    int truncated = 0;
+    int n = parse_digits(p, len, &i, &w, &nd, &exp10, 0, &truncated);
+    if (i + 1 < len && p[i] == '.' && is_digit(p[i + 1])) {
+        i++;
+        n += parse_digits(p, len, &i, &w, &nd, &exp10, 1, &truncated);
+    }
+    if (n == 0) {
+        return 0.0;
+    }
+
+    if (i < len && (p[i] == 'e' || p[i] == 'E')) {
+        int j = i + 1;
+        int eneg = 0;
+        if (j < len && (p[j] == '+' || p[j] == '-')) {
+            eneg = (p[j] == '-');
+            j++;
+        }
+        if (j < len && is_digit(p[j])) {
+            int e = 0;
+            for (; j < len && (is_digit(p[j]) || digit_separator(p, j, len)); j++) {
+                if (is_digit(p[j]) && e < 100000) {
+                    e = e * 10 + (p[j] - '0');
+                }
+            }
+            exp10 += eneg ? -e : e;
+            i = j;
+        }
+    }
+
+    /* one exact operation on exact operands rounds correctly */
+    if (!truncated && w < EXACT_INT_MAX) {
+        double d = (double)w;
+        if (w == 0) {
+            return neg ? -0.0 : 0.0;
+        }
+        if (exp10 >= 0 && exp10 <= POW10_EXACT_MAX) {
+            d *= pow10_exact[exp10];
+            return neg ? -d : d;
+        }
+        if (exp10 < 0 && exp10 >= -POW10_EXACT_MAX) {
+            d /= pow10_exact[-exp10];
+            return neg ? -d : d;
+        }
+    }
+
+    /* the text without separators, for strtod() */
+    char text[PARSE_TEXT_MAX];
+    int t = 0;
+    for (int j = start; j < i; j++) {
+        if (p[j] != '_') {
+            if (t == PARSE_TEXT_MAX - 1) {
+                break;
+            }
+            text[t++] = p[j];
+        }
+    }
+    if (t == PARSE_TEXT_MAX - 1) {
+        /* too long: the kept digits, and a 1 standing for any dropped */
+        snprintf(text, sizeof(text), "%s%llu%se%d", neg ? "-" : "", (unsigned long long)w,
+                 truncated ? "1" : "", exp10 - truncated);
+    } else {
+        text[t] = '\0';
+    }
+    return strtod(text, NULL);
+}
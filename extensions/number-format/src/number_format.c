@@ -0,0 +1,699 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file number_format.c
+ * @brief Integer#to_s, Float#to_s, String#to_i, String#to_f, and
+ *        sprintf / format / String#% for numeric conversions
+ *
+ * The conversions are in number.c. Format strings are parsed into a
+ * list of conversions, and the most recently used ones are cached by
+ * their text, so a format in a loop is parsed once.
+ *
+ * Anything outside the fast paths goes to the method this one
+ * replaced: a base other than 10, %e and %g, the # and * flags,
+ * negative numbers in %x, %o and %b, and arguments that are not
+ * Integers, Floats or Strings where a number or text is expected.
+ */
+
+#include <hako/extension.h>
+#include <hako/method.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hako_number.h"
+#include "number_format_ext.h"
+
+LOG_MODULE_REGISTER(hako_number_format, CONFIG_HAKO_LOG_LEVEL);
+
+/* Longest format text kept in the cache; longer ones are parsed per call */
+#define FORMAT_KEY_MAX 64
+
+/* Widths and precisions above this go to the replaced method */
+#define FORMAT_WIDTH_MAX 1024
+
+/* Floats this large in %f go to the replaced method */
+#define FORMAT_FLOAT_MAX 1e40
+
+/* Arguments String#% can hand to the replaced sprintf */
+#define FORMAT_CHAIN_ARGS 16
+
+enum {
+    FMT_LEFT = 0x01,    /* - */
+    FMT_ZERO = 0x02,    /* 0 */
+    FMT_PLUS = 0x04,    /* + */
+    FMT_SPACE = 0x08,   /* space */
+};
+
+/* One conversion, with the literal text before it */
+struct format_spec {
+    uint16_t lit_off;
+    uint16_t lit_len;
+    char conv;          /* d x X o b f s c, or % for a literal % */
+    uint8_t flags;
+    int16_t width;      /* -1 if none */
+    int16_t prec;       /* -1 if none */
+};
+
+struct format_template {
+    uint32_t hash;      /* 0 = empty slot */
+    uint8_t key_len;
+    uint8_t n_specs;
+    uint8_t chain;      /* not handled here; use the replaced method */
+    uint16_t tail_off;
+    uint16_t tail_len;
+    char key[FORMAT_KEY_MAX];
+    struct format_spec specs[CONFIG_HAKO_NUMBER_FORMAT_MAX_SPECS];
+};
+
+static struct format_template format_cache[CONFIG_HAKO_NUMBER_FORMAT_CACHE_SIZE];
+static struct format_template format_scratch;
+static unsigned int format_cache_next;
+
+static mrbc_func_t orig_integer_to_s;
+static mrbc_func_t orig_string_to_i;
+static mrbc_func_t orig_sprintf;
+static mrbc_func_t orig_format;
+static mrbc_func_t orig_string_percent;
+
+/*
+ * Integer#to_s, Float#to_s, String#to_i, String#to_f
+ */
+
+static int base_10(mrbc_value *v, int argc)
+{
+    return argc == 0 || (v[1].tt == MRBC_TT_INTEGER && v[1].i == 10);
+}
+
+static void c_integer_to_s(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (!base_10(v, argc)) {
+        hako_call_original(vm, v, argc, orig_integer_to_s,
+                           MRBC_CLASS(ArgumentError), "unsupported conversion");
+        return;
+    }
+
+    char buf[HAKO_NUMBER_INT_MAX];
+    int n = hako_number_itoa(buf, v[0].i);
+    SET_RETURN(mrbc_string_new(vm, buf, n));
+}
+
+static void c_string_to_i(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (!base_10(v, argc)) {
+        hako_call_original(vm, v, argc, orig_string_to_i,
+                           MRBC_CLASS(ArgumentError), "unsupported conversion");
+        return;
+    }
+    SET_INT_RETURN((mrbc_int_t)hako_number_atoi(v[0].string->data, v[0].string->size));
+}
+
+#if MRBC_USE_FLOAT
+static void c_float_to_s(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    char buf[HAKO_NUMBER_FLOAT_MAX];
+    int n = hako_number_dtoa(buf, v[0].d);
+    SET_RETURN(mrbc_string_new(vm, buf, n));
+}
+
+static void c_string_to_f(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    double d = hako_number_atof(v[0].string->data, v[0].string->size);
+    SET_RETURN(mrbc_float_value(vm, d));
+}
+#endif
+
+/*
+ * Format templates
+ */
+
+static int parse_count(const char *fmt, int len, int *i)
+{
+    int n = 0;
+
+    while (*i < len && fmt[*i] >= '0' && fmt[*i] <= '9') {
+        n = n * 10 + (fmt[(*i)++] - '0');
+        if (n > FORMAT_WIDTH_MAX) {
+            return -1;
+        }
+    }
+    return n;
+}
+
+/* Parse fmt into t; t->chain is set if some part is not handled here */
+static void format_compile(struct format_template *t, const char *fmt, int len)
+{
+    int lit = 0;
+    int i = 0;
+
+    t->n_specs = 0;
+    t->chain = 1;
+    if (len > UINT16_MAX) {
+        return;
+    }
+    while (i < len) {
+        if (fmt[i] != '%') {
+            i++;
+            continue;
+        }
+        if (t->n_specs == CONFIG_HAKO_NUMBER_FORMAT_MAX_SPECS) {
+            return;
+        }
+
+        struct format_spec *s = &t->specs[t->n_specs];
+        s->lit_off = lit;
+        s->lit_len = i - lit;
+        s->flags = 0;
+        s->width = -1;
+        s->prec = -1;
+
+        for (i++; i < len; i++) {
+            if (fmt[i] == '-') {
+                s->flags |= FMT_LEFT;
+            } else if (fmt[i] == '0') {
+                s->flags |= FMT_ZERO;
+            } else if (fmt[i] == '+') {
+                s->flags |= FMT_PLUS;
+            } else if (fmt[i] == ' ') {
+                s->flags |= FMT_SPACE;
+            } else {
+                break;
+            }
+        }
+        if (i < len && fmt[i] >= '1' && fmt[i] <= '9') {
+            s->width = parse_count(fmt, len, &i);
+            if (s->width < 0) {
+                return;
+            }
+        }
+        if (i < len && fmt[i] == '.') {
+            i++;
+            s->prec = parse_count(fmt, len, &i);
+            if (s->prec < 0) {
+                return;
+            }
+        }
+        if (i == len) {
+            return;
+        }
+
+        switch (fmt[i]) {
+        case 'd':
+        case 'i':
+        case 'u':
+            s->conv = 'd';
+            break;
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'b':
+        case 'f':
+        case 's':
+        case 'c':
+            s->conv = fmt[i];
+            break;
+        case '%':
+            if (s->flags || s->width >= 0 || s->prec >= 0) {
+                return;
+            }
+            s->conv = '%';
+            break;
+        default:
+            /* %e, %g, %#x, %*d, %<name>s, ... */
+            return;
+        }
+        i++;
+        lit = i;
+        t->n_specs++;
+    }
+
+    t->tail_off = lit;
+    t->tail_len = len - lit;
+    t->chain = 0;
+}
+
+/* Look up the template for fmt, parsing and caching it on a miss */
+static const struct format_template *format_template_get(const char *fmt, int len)
+{
+    /* FNV-1a; never 0 so that 0 can mark an empty slot */
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)fmt[i]) * 16777619u;
+    }
+    hash |= 1;
+
+    struct format_template *t;
+    if (len <= FORMAT_KEY_MAX) {
+        for (int i = 0; i < CONFIG_HAKO_NUMBER_FORMAT_CACHE_SIZE; i++) {
+            t = &format_cache[i];
+            if (t->hash == hash && t->key_len == len && memcmp(t->key, fmt, len) == 0) {
+                return t;
+            }
+        }
+        t = &format_cache[format_cache_next];
+        format_cache_next = (format_cache_next + 1) % CONFIG_HAKO_NUMBER_FORMAT_CACHE_SIZE;
+    } else {
+        t = &format_scratch;
+    }
+
+    format_compile(t, fmt, len);
+    if (t != &format_scratch) {
+        t->hash = hash;
+        t->key_len = (uint8_t)len;
+        memcpy(t->key, fmt, len);
+    }
+    return t;
+}
+
+/*
+ * Formatting
+ */
+
+struct format_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    uint8_t local[128];
+};
+
+/* Reserve n bytes at the end of the buffer; NULL if out of memory */
+static uint8_t *format_reserve(mrbc_vm *vm, struct format_buf *b, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap * 2;
+        while (cap < b->len + n) {
+            cap *= 2;
+        }
+        uint8_t *data;
+        if (b->data == b->local) {
+            data = mrbc_alloc(vm, cap);
+            if (data) {
+                memcpy(data, b->local, b->len);
+            }
+        } else {
+            data = mrbc_realloc(vm, b->data, cap);
+        }
+        if (!data) {
+            return NULL;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+
+    uint8_t *p = b->data + b->len;
+    b->len += n;
+    return p;
+}
+
+static int format_append(mrbc_vm *vm, struct format_buf *b, const void *src, size_t n)
+{
+    uint8_t *p = format_reserve(vm, b, n);
+
+    if (!p) {
+        return -1;
+    }
+    memcpy(p, src, n);
+    return 0;
+}
+
+/* Characters in a UTF-8 String, for widths and precisions */
+static int utf8_chars(const uint8_t *s, int len)
+{
+    int n = 0;
+
+    for (int i = 0; i < len; i++) {
+        n += (s[i] & 0xc0) != 0x80;
+    }
+    return n;
+}
+
+/* Bytes taken by the first n characters of a UTF-8 String */
+static int utf8_prefix(const uint8_t *s, int len, int n)
+{
+    int i = 0;
+
+    while (i < len && n > 0) {
+        i++;
+        while (i < len && (s[i] & 0xc0) == 0x80) {
+            i++;
+        }
+        n--;
+    }
+    return i;
+}
+
+/*
+ * Append sign, zeros and body padded to the spec's width. chars is the
+ * body's width in characters; zeros are leading zeros from a precision.
+ */
+static int format_field(mrbc_vm *vm, struct format_buf *b, const struct format_spec *s,
+                        const char *sign, const void *body, int len, int chars, int zeros)
+{
+    int sign_len = strlen(sign);
+    int pad = s->width - (sign_len + zeros + chars);
+    int zero_pad = (s->flags & FMT_ZERO) && !(s->flags & FMT_LEFT) &&
+                   s->conv != 's' && s->conv != 'c' && !(s->conv != 'f' && s->prec >= 0);
+
+    if (pad < 0) {
+        pad = 0;
+    }
+    if (zero_pad) {
+        zeros += pad;
+        pad = 0;
+    }
+
+    uint8_t *p = format_reserve(vm, b, pad + sign_len + zeros + len);
+    if (!p) {
+        return -1;
+    }
+    if (!(s->flags & FMT_LEFT)) {
+        memset(p, ' ', pad);
+        p += pad;
+    }
+    memcpy(p, sign, sign_len);
+    p += sign_len;
+    memset(p, '0', zeros);
+    p += zeros;
+    memcpy(p, body, len);
+    if (s->flags & FMT_LEFT) {
+        memset(p + len, ' ', pad);
+    }
+    return 0;
+}
+
+static const char *sign_of(const struct format_spec *s, int negative)
+{
+    if (negative) {
+        return "-";
+    }
+    return (s->flags & FMT_PLUS) ? "+" : (s->flags & FMT_SPACE) ? " " : "";
+}
+
+/* Digits of x in base 2, 8 or 16, written backwards to end */
+static char *radix_back(char *end, uint64_t x, int shift, const char *digits)
+{
+    char *p = end;
+
+    do {
+        *--p = digits[x & ((1u << shift) - 1)];
+        x >>= shift;
+    } while (x);
+    return p;
+}
+
+/* 0 on success, 1 if the argument is not handled here, -1 on no memory */
+static int format_one(mrbc_vm *vm, struct format_buf *b, const struct format_spec *s,
+                      const mrbc_value *arg)
+{
+    char tmp[72];
+    char *end = tmp + sizeof(tmp);
+    const char *body;
+    int len;
+
+    switch (s->conv) {
+    case 'd':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'b': {
+        if (arg->tt != MRBC_TT_INTEGER) {
+            return 1;
+        }
+        mrbc_int_t x = arg->i;
+        if (s->conv == 'd') {
+            /* the sign goes before any padding zeros, so leave it off */
+            len = hako_number_itoa(tmp, x);
+            body = tmp;
+            if (x < 0) {
+                body++;
+                len--;
+            }
+        } else {
+            if (x < 0) {
+                return 1;
+            }
+            int shift = (s->conv == 'b') ? 1 : (s->conv == 'o') ? 3 : 4;
+            const char *digits = (s->conv == 'X') ? "0123456789ABCDEF" : "0123456789abcdef";
+            body = radix_back(end, (uint64_t)x, shift, digits);
+            len = end - body;
+        }
+        if (s->prec == 0 && x == 0) {
+            /* as in C, no digits at all */
+            len = 0;
+        }
+        int zeros = (s->prec > len) ? s->prec - len : 0;
+        return format_field(vm, b, s, sign_of(s, x < 0), body, len, len, zeros);
+    }
+
+#if MRBC_USE_FLOAT
+    case 'f': {
+        int prec = (s->prec >= 0) ? s->prec : 6;
+        if (prec > 22) {
+            return 1;
+        }
+
+        if (arg->tt == MRBC_TT_INTEGER) {
+            /* exactly, not through a double */
+            mrbc_int_t x = arg->i;
+            len = hako_number_itoa(tmp, x);
+            body = tmp;
+            if (x < 0) {
+                body++;
+                len--;
+            }
+            if (prec > 0) {
+                tmp[len + (x < 0)] = '.';
+                memset(tmp + len + (x < 0) + 1, '0', prec);
+                len += prec + 1;
+            }
+            return format_field(vm, b, s, sign_of(s, x < 0), body, len, len, 0);
+        }
+        if (arg->tt != MRBC_TT_FLOAT) {
+            return 1;
+        }
+
+        double d = arg->d;
+        if (!(d > -FORMAT_FLOAT_MAX && d < FORMAT_FLOAT_MAX)) {
+            return 1;
+        }
+        len = hako_number_fixed(tmp, d, prec);
+        if (len < 0) {
+            /* within rounding error of a half: let printf() decide */
+            len = snprintf(tmp, sizeof(tmp), "%.*f", prec, (d < 0) ? -d : d);
+        }
+        uint64_t bits;
+        memcpy(&bits, &d, sizeof(bits));
+        return format_field(vm, b, s, sign_of(s, bits >> 63), tmp, len, len, 0);
+    }
+#endif
+
+    case 's':
+        switch (arg->tt) {
+        case MRBC_TT_STRING:
+            body = (const char *)arg->string->data;
+            len = arg->string->size;
+            break;
+        case MRBC_TT_INTEGER:
+            len = hako_number_itoa(tmp, arg->i);
+            body = tmp;
+            break;
+#if MRBC_USE_FLOAT
+        case MRBC_TT_FLOAT:
+            len = hako_number_dtoa(tmp, arg->d);
+            body = tmp;
+            break;
+#endif
+        case MRBC_TT_SYMBOL:
+            body = mrbc_symid_to_str(arg->sym_id);
+            len = strlen(body);
+            break;
+        case MRBC_TT_NIL:
+            body = "";
+            len = 0;
+            break;
+        case MRBC_TT_TRUE:
+            body = "true";
+            len = 4;
+            break;
+        case MRBC_TT_FALSE:
+            body = "false";
+            len = 5;
+            break;
+        default:
+            return 1;
+        }
+        if (s->prec >= 0) {
+            len = utf8_prefix((const uint8_t *)body, len, s->prec);
+        }
+        return format_field(vm, b, s, "", body, len, utf8_chars((const uint8_t *)body, len), 0);
+
+    case 'c':
+        if (arg->tt == MRBC_TT_INTEGER && arg->i >= 0 && arg->i < 0x80) {
+            tmp[0] = (char)arg->i;
+            return format_field(vm, b, s, "", tmp, 1, 1, 0);
+        }
+        if (arg->tt == MRBC_TT_STRING && arg->string->size > 0) {
+            const uint8_t *str = arg->string->data;
+            len = utf8_prefix(str, arg->string->size, 1);
+            return format_field(vm, b, s, "", str, len, 1, 0);
+        }
+        return 1;
+
+    default:
+        return 1;
+    }
+}
+
+/*
+ * Format args into a new String at *out. Returns 0 on success, 1 if
+ * the replaced method should handle the call, -1 if out of memory.
+ */
+static int format_values(mrbc_vm *vm, const mrbc_value *fmt, const mrbc_value *args, int n_args,
+                         mrbc_value *out)
+{
+    const char *text = (const char *)fmt->string->data;
+    const struct format_template *t = format_template_get(text, fmt->string->size);
+    if (t->chain) {
+        return 1;
+    }
+
+    struct format_buf b;
+    b.data = b.local;
+    b.len = 0;
+    b.cap = sizeof(b.local);
+
+    int ret = 0;
+    int arg = 0;
+    for (int i = 0; i < t->n_specs && ret == 0; i++) {
+        const struct format_spec *s = &t->specs[i];
+        ret = format_append(vm, &b, text + s->lit_off, s->lit_len);
+        if (ret != 0) {
+            break;
+        }
+        if (s->conv == '%') {
+            ret = format_append(vm, &b, "%", 1);
+        } else if (arg == n_args) {
+            /* too few arguments: the replaced method raises */
+            ret = 1;
+        } else {
+            ret = format_one(vm, &b, s, &args[arg++]);
+        }
+    }
+    if (ret == 0) {
+        ret = format_append(vm, &b, text + t->tail_off, t->tail_len);
+    }
+
+    if (ret == 0) {
+        *out = mrbc_string_new(vm, b.data, b.len);
+    }
+    if (b.data != b.local) {
+        mrbc_free(vm, b.data);
+    }
+    return ret;
+}
+
+static void object_format(mrbc_vm *vm, mrbc_value *v, int argc, mrbc_func_t orig)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        hako_call_original(vm, v, argc, orig,
+                           MRBC_CLASS(ArgumentError), "unsupported conversion");
+        return;
+    }
+
+    mrbc_value out;
+    int ret = format_values(vm, &v[1], &v[2], argc - 1, &out);
+    if (ret > 0) {
+        hako_call_original(vm, v, argc, orig,
+                           MRBC_CLASS(ArgumentError), "unsupported conversion");
+    } else if (ret < 0) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+    } else {
+        SET_RETURN(out);
+    }
+}
+
+static void c_object_sprintf(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    object_format(vm, v, argc, orig_sprintf);
+}
+
+static void c_object_format(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    object_format(vm, v, argc, orig_format);
+}
+
+/* format % arg, or format % [args]: as sprintf(format, *args) */
+static void c_string_percent(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc != 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+
+    const mrbc_value *args = &v[1];
+    int n_args = 1;
+    if (v[1].tt == MRBC_TT_ARRAY) {
+        args = v[1].array->data;
+        n_args = v[1].array->n_stored;
+    }
+
+    mrbc_value out;
+    int ret = format_values(vm, &v[0], args, n_args, &out);
+    if (ret == 0) {
+        SET_RETURN(out);
+        return;
+    }
+    if (ret < 0) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+    if (orig_string_percent) {
+        orig_string_percent(vm, v, argc);
+        return;
+    }
+    if (!orig_sprintf || n_args > FORMAT_CHAIN_ARGS) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "unsupported conversion");
+        return;
+    }
+
+    /* sprintf(format, *args), on registers of our own; the values are borrowed */
+    mrbc_value regs[FORMAT_CHAIN_ARGS + 3];
+    regs[0] = mrbc_nil_value();
+    regs[1] = v[0];
+    memcpy(&regs[2], args, sizeof(mrbc_value) * n_args);
+    regs[n_args + 2] = mrbc_nil_value();
+    orig_sprintf(vm, regs, n_args + 1);
+    SET_RETURN(regs[0]);
+}
+
+/**
+ * Initialize the number format extension
+ */
+void mrbc_number_format_init(void)
+{
+    orig_integer_to_s = hako_find_c_method(MRBC_CLASS(Integer), "to_s");
+    orig_string_to_i = hako_find_c_method(MRBC_CLASS(String), "to_i");
+    orig_sprintf = hako_find_c_method(mrbc_class_object, "sprintf");
+    orig_format = hako_find_c_method(mrbc_class_object, "format");
+    if (!orig_format) {
+        orig_format = orig_sprintf;
+    }
+    orig_string_percent = hako_find_c_method(MRBC_CLASS(String), "%");
+
+    mrbc_define_method(0, MRBC_CLASS(Integer), "to_s", c_integer_to_s);
+    mrbc_define_method(0, MRBC_CLASS(String), "to_i", c_string_to_i);
+#if MRBC_USE_FLOAT
+    mrbc_define_method(0, MRBC_CLASS(Float), "to_s", c_float_to_s);
+    mrbc_define_method(0, MRBC_CLASS(Float), "inspect", c_float_to_s);
+    mrbc_define_method(0, MRBC_CLASS(String), "to_f", c_string_to_f);
+#endif
+    mrbc_define_method(0, mrbc_class_object, "sprintf", c_object_sprintf);
+    mrbc_define_method(0, mrbc_class_object, "format", c_object_format);
+    mrbc_define_method(0, MRBC_CLASS(String), "%", c_string_percent);
+
+    LOG_DBG("Number format registered");
+}
+
+HAKO_EXTENSION_DEFINE(number_format, mrbc_number_format_init, HAKO_EXTENSION_PRIORITY_LATE);
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file pack_ext.h
+ * @brief Array#pack / String#unpack extension public API
+ */
+
+#ifndef PACK_EXT_H
+#define PACK_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the pack extension
+ *
+ * Registers Array#pack, String#unpack and String#unpack1 with the
+ * mruby/c VM. Called automatically by HAKO loader during initialization.
+ */
+void mrbc_pack_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PACK_EXT_H */
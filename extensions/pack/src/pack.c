@@ -0,0 +1,823 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file pack.c
+ * @brief Array#pack, String#unpack and String#unpack1
+ *
+ * Templates are parsed by Prism's pack parser into a list of operations.
+ * The most recently used templates are cached by their text, so a frame
+ * decoded in a loop has its template parsed once.
+ */
+
+/* See prism_pack.c: the parser is built without PRISM_BUILD_MINIMAL */
+#undef PRISM_BUILD_MINIMAL
+#undef PRISM_EXCLUDE_PACK
+
+#include <hako/extension.h>
+#include <mrubyc.h>
+#include <prism/pack.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <string.h>
+
+#include "pack_ext.h"
+
+LOG_MODULE_REGISTER(hako_pack, CONFIG_HAKO_LOG_LEVEL);
+
+/* Longest template text kept in the cache; longer ones are parsed per call */
+#define PACK_KEY_MAX 32
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PACK_NATIVE_BIG 1
+#else
+#define PACK_NATIVE_BIG 0
+#endif
+
+struct pack_op {
+    uint8_t type;       /* pm_pack_type */
+    uint8_t is_signed;
+    uint8_t big_endian;
+    uint8_t size;       /* bytes, integers and floats only */
+    uint8_t star;       /* count was '*' */
+    uint32_t count;
+};
+
+struct pack_template {
+    uint32_t hash;      /* 0 = empty slot */
+    uint8_t variant;
+    uint8_t key_len;
+    uint8_t n_ops;
+    char key[PACK_KEY_MAX];
+    struct pack_op ops[CONFIG_HAKO_PACK_MAX_DIRECTIVES];
+};
+
+static struct pack_template pack_cache[CONFIG_HAKO_PACK_CACHE_SIZE];
+static struct pack_template pack_scratch;
+static unsigned int pack_cache_next;
+
+/**
+ * Parse a template into t. Returns NULL on success, or an error message
+ * with the offending directive in *bad.
+ */
+static const char *pack_compile(struct pack_template *t, pm_pack_variant variant,
+                                const char *fmt, size_t len, char *bad)
+{
+    const char *p = fmt;
+    const char *end = fmt + len;
+    pm_pack_encoding encoding = PM_PACK_ENCODING_START;
+
+    t->n_ops = 0;
+    for (;;) {
+        pm_pack_type type;
+        pm_pack_signed signed_type;
+        pm_pack_endian endian;
+        pm_pack_size size;
+        pm_pack_length_type length_type;
+        uint64_t length;
+
+        *bad = *p;
+        switch (pm_pack_parse(variant, &p, end, &type, &signed_type, &endian,
+                              &size, &length_type, &length, &encoding)) {
+        case PM_PACK_OK:
+            break;
+        case PM_PACK_ERROR_LENGTH_TOO_BIG:
+            return "pack length too big for";
+        case PM_PACK_ERROR_BANG_NOT_ALLOWED:
+            return "'_' and '!' not allowed after";
+        case PM_PACK_ERROR_DOUBLE_ENDIAN:
+            return "both '<' and '>' given for";
+        default:
+            return "unknown pack directive";
+        }
+
+        switch (type) {
+        case PM_PACK_END:
+            return NULL;
+        case PM_PACK_SPACE:
+        case PM_PACK_COMMENT:
+            continue;
+        case PM_PACK_MOVE:
+            /* unpack '@*' stays at the current offset */
+            if (length_type == PM_PACK_LENGTH_RELATIVE) {
+                continue;
+            }
+            break;
+#if MRBC_USE_FLOAT
+        case PM_PACK_FLOAT:
+#endif
+        case PM_PACK_INTEGER:
+        case PM_PACK_UTF8:
+        case PM_PACK_STRING_SPACE_PADDED:
+        case PM_PACK_STRING_NULL_PADDED:
+        case PM_PACK_STRING_NULL_TERMINATED:
+        case PM_PACK_STRING_MSB:
+        case PM_PACK_STRING_LSB:
+        case PM_PACK_STRING_HEX_HIGH:
+        case PM_PACK_STRING_HEX_LOW:
+        case PM_PACK_BACK:
+        case PM_PACK_NULL:
+            break;
+        default:
+            return "unsupported pack directive";
+        }
+
+        if (length > UINT32_MAX) {
+            return "pack length too big for";
+        }
+        if (t->n_ops == CONFIG_HAKO_PACK_MAX_DIRECTIVES) {
+            return "too many directives in template at";
+        }
+
+        struct pack_op *op = &t->ops[t->n_ops++];
+        op->type = type;
+        op->is_signed = (signed_type == PM_PACK_SIGNED);
+        op->big_endian = (endian == PM_PACK_BIG_ENDIAN) ||
+                         (endian == PM_PACK_NATIVE_ENDIAN && PACK_NATIVE_BIG);
+        op->size = (uint8_t)pm_size_to_native(size);
+        op->star = (length_type == PM_PACK_LENGTH_MAX);
+        op->count = (uint32_t)length;
+    }
+}
+
+/**
+ * Look up the template in v, parsing and caching it on a miss.
+ * Raises and returns NULL if it is not a valid template.
+ */
+static const struct pack_template *pack_template_get(mrbc_vm *vm, mrbc_value *v,
+                                                     pm_pack_variant variant)
+{
+    if (v->tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "template is not a String");
+        return NULL;
+    }
+
+    const char *fmt = (const char *)v->string->data;
+    size_t len = v->string->size;
+
+    /* FNV-1a; never 0 so that 0 can mark an empty slot */
+    uint32_t hash = 2166136261u ^ (uint32_t)variant;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)fmt[i]) * 16777619u;
+    }
+    hash |= 1;
+
+    struct pack_template *t;
+    if (len <= PACK_KEY_MAX) {
+        for (int i = 0; i < CONFIG_HAKO_PACK_CACHE_SIZE; i++) {
+            t = &pack_cache[i];
+            if (t->hash == hash && t->variant == variant && t->key_len == len &&
+                memcmp(t->key, fmt, len) == 0) {
+                return t;
+            }
+        }
+        t = &pack_cache[pack_cache_next];
+        pack_cache_next = (pack_cache_next + 1) % CONFIG_HAKO_PACK_CACHE_SIZE;
+    } else {
+        t = &pack_scratch;
+    }
+
+    char bad[2] = { 0, 0 };
+    const char *err = pack_compile(t, variant, fmt, len, &bad[0]);
+    if (err) {
+        t->hash = 0;
+        mrbc_raisef(vm, MRBC_CLASS(ArgumentError), "%s '%s'", err, bad);
+        return NULL;
+    }
+
+    if (t != &pack_scratch) {
+        t->hash = hash;
+        t->variant = variant;
+        t->key_len = (uint8_t)len;
+        memcpy(t->key, fmt, len);
+    }
+    return t;
+}
+
+/*
+ * Array#pack
+ */
+
+struct pack_buf {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    uint8_t local[64];
+};
+
+/* Reserve n bytes at the end of the buffer; NULL if out of memory */
+static uint8_t *pack_reserve(mrbc_vm *vm, struct pack_buf *b, size_t n)
+{
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap * 2;
+        while (cap < b->len + n) {
+            cap *= 2;
+        }
+        uint8_t *data;
+        if (b->data == b->local) {
+            data = mrbc_alloc(vm, cap);
+            if (data) {
+                memcpy(data, b->local, b->len);
+            }
+        } else {
+            data = mrbc_realloc(vm, b->data, cap);
+        }
+        if (!data) {
+            return NULL;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+
+    uint8_t *p = b->data + b->len;
+    b->len += n;
+    return p;
+}
+
+static void store_uint(uint8_t *p, uint64_t x, int size, int big_endian)
+{
+    for (int i = 0; i < size; i++) {
+        p[big_endian ? size - 1 - i : i] = (uint8_t)x;
+        x >>= 8;
+    }
+}
+
+static int utf8_encode(uint8_t *p, uint32_t c)
+{
+    if (c < 0x80) {
+        p[0] = c;
+        return 1;
+    }
+    if (c < 0x800) {
+        p[0] = 0xc0 | (c >> 6);
+        p[1] = 0x80 | (c & 0x3f);
+        return 2;
+    }
+    if (c < 0x10000) {
+        p[0] = 0xe0 | (c >> 12);
+        p[1] = 0x80 | ((c >> 6) & 0x3f);
+        p[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+    p[0] = 0xf0 | (c >> 18);
+    p[1] = 0x80 | ((c >> 12) & 0x3f);
+    p[2] = 0x80 | ((c >> 6) & 0x3f);
+    p[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
+
+static int hex_nibble(uint8_t c)
+{
+    return (((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) ? (c & 15) + 9 : c) & 15;
+}
+
+
+static int pack_nomem(mrbc_vm *vm)
+{
+    mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+    return -1;
+}
+
+static int pack_string_item(mrbc_vm *vm, const struct pack_op *op, struct pack_buf *b,
+                            const mrbc_value *item)
+{
+    if (item->tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return -1;
+    }
+    const uint8_t *s = item->string->data;
+    size_t slen = item->string->size;
+    uint8_t *p;
+
+    switch (op->type) {
+    case PM_PACK_STRING_MSB:
+    case PM_PACK_STRING_LSB: {
+        size_t bits = op->star ? slen : op->count;
+        if (!(p = pack_reserve(vm, b, (bits + 7) / 8))) {
+            return pack_nomem(vm);
+        }
+        memset(p, 0, (bits + 7) / 8);
+        for (size_t i = 0; i < bits && i < slen; i++) {
+            if (s[i] & 1) {
+                p[i / 8] |= (op->type == PM_PACK_STRING_MSB) ? 0x80 >> (i % 8) : 1 << (i % 8);
+            }
+        }
+        return 0;
+    }
+
+    case PM_PACK_STRING_HEX_HIGH:
+    case PM_PACK_STRING_HEX_LOW: {
+        size_t nibbles = op->star ? slen : op->count;
+        if (!(p = pack_reserve(vm, b, (nibbles + 1) / 2))) {
+            return pack_nomem(vm);
+        }
+        memset(p, 0, (nibbles + 1) / 2);
+        for (size_t i = 0; i < nibbles && i < slen; i++) {
+            int high = (op->type == PM_PACK_STRING_HEX_HIGH) == (i % 2 == 0);
+            p[i / 2] |= hex_nibble(s[i]) << (high ? 4 : 0);
+        }
+        return 0;
+    }
+
+    default: {
+        /* a, A, Z: padded to the count, or the whole string for '*' */
+        size_t width = op->star ? slen + (op->type == PM_PACK_STRING_NULL_TERMINATED)
+                                : op->count;
+        size_t copy = slen < width ? slen : width;
+        if (!(p = pack_reserve(vm, b, width))) {
+            return pack_nomem(vm);
+        }
+        memcpy(p, s, copy);
+        memset(p + copy, op->type == PM_PACK_STRING_SPACE_PADDED ? ' ' : 0, width - copy);
+        return 0;
+    }
+    }
+}
+
+static int pack_number_item(mrbc_vm *vm, const struct pack_op *op, struct pack_buf *b,
+                            const mrbc_value *item)
+{
+    int64_t n;
+#if MRBC_USE_FLOAT
+    double d;
+    if (item->tt == MRBC_TT_FLOAT) {
+        d = item->d;
+        /* NaN fails both comparisons; 0x1p63 is exactly INT64_MAX + 1 */
+        if (op->type != PM_PACK_FLOAT && !(d >= -0x1p63 && d < 0x1p63)) {
+            mrbc_raise(vm, MRBC_CLASS(RangeError), "float out of range of integer");
+            return -1;
+        }
+        n = op->type == PM_PACK_FLOAT ? 0 : (int64_t)d;
+    } else
+#endif
+    if (item->tt == MRBC_TT_INTEGER) {
+        n = item->i;
+#if MRBC_USE_FLOAT
+        d = (double)item->i;
+#endif
+    } else {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into Integer");
+        return -1;
+    }
+
+    uint8_t *p;
+    if (op->type == PM_PACK_UTF8) {
+        if (n < 0 || n > 0x10ffff) {
+            mrbc_raise(vm, MRBC_CLASS(RangeError), "pack(U): value out of range");
+            return -1;
+        }
+        if (!(p = pack_reserve(vm, b, 4))) {
+            return pack_nomem(vm);
+        }
+        b->len -= 4 - utf8_encode(p, (uint32_t)n);
+        return 0;
+    }
+
+    if (!(p = pack_reserve(vm, b, op->size))) {
+        return pack_nomem(vm);
+    }
+#if MRBC_USE_FLOAT
+    if (op->type == PM_PACK_FLOAT) {
+        if (op->size == 4) {
+            float f = (float)d;
+            uint32_t u;
+            memcpy(&u, &f, 4);
+            store_uint(p, u, 4, op->big_endian);
+        } else {
+            uint64_t u;
+            memcpy(&u, &d, 8);
+            store_uint(p, u, 8, op->big_endian);
+        }
+        return 0;
+    }
+#endif
+    store_uint(p, (uint64_t)n, op->size, op->big_endian);
+    return 0;
+}
+
+/* Pack one operation, consuming items from *idx; raises and returns -1 on error */
+static int pack_op(mrbc_vm *vm, const struct pack_op *op, struct pack_buf *b,
+                   const mrbc_value *items, int n_items, int *idx)
+{
+    uint8_t *p;
+
+    switch (op->type) {
+    case PM_PACK_INTEGER:
+    case PM_PACK_FLOAT:
+    case PM_PACK_UTF8: {
+        uint32_t count = op->star ? (uint32_t)(n_items - *idx) : op->count;
+        if (count > (uint32_t)(n_items - *idx)) {
+            break;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (pack_number_item(vm, op, b, &items[(*idx)++]) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    case PM_PACK_NULL:
+        if (!(p = pack_reserve(vm, b, op->count))) {
+            return pack_nomem(vm);
+        }
+        memset(p, 0, op->count);
+        return 0;
+
+    case PM_PACK_BACK:
+        if (op->count > b->len) {
+            mrbc_raise(vm, MRBC_CLASS(ArgumentError), "X outside of string");
+            return -1;
+        }
+        b->len -= op->count;
+        return 0;
+
+    case PM_PACK_MOVE:
+        if (op->count > b->len) {
+            size_t pad = op->count - b->len;
+            if (!(p = pack_reserve(vm, b, pad))) {
+                return pack_nomem(vm);
+            }
+            memset(p, 0, pad);
+        } else {
+            b->len = op->count;
+        }
+        return 0;
+
+    default:
+        /* String directives take one item */
+        if (*idx >= n_items) {
+            break;
+        }
+        return pack_string_item(vm, op, b, &items[(*idx)++]);
+    }
+
+    mrbc_raise(vm, MRBC_CLASS(ArgumentError), "too few arguments");
+    return -1;
+}
+
+/**
+ * array.pack(template) -> String
+ */
+static void c_array_pack(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc != 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+
+    const struct pack_template *t = pack_template_get(vm, &v[1], PM_PACK_VARIANT_PACK);
+    if (!t) {
+        return;
+    }
+
+    struct pack_buf b;
+    b.data = b.local;
+    b.len = 0;
+    b.cap = sizeof(b.local);
+
+    const mrbc_value *items = v[0].array->data;
+    int n_items = v[0].array->n_stored;
+    int idx = 0;
+    int ret = 0;
+
+    for (int i = 0; i < t->n_ops && ret == 0; i++) {
+        ret = pack_op(vm, &t->ops[i], &b, items, n_items, &idx);
+    }
+
+    if (ret == 0) {
+        mrbc_value str = mrbc_string_new(vm, b.data, b.len);
+        if (str.tt != MRBC_TT_STRING || !str.string) {
+            pack_nomem(vm);
+        } else {
+            SET_RETURN(str);
+        }
+    }
+    if (b.data != b.local) {
+        mrbc_free(vm, b.data);
+    }
+}
+
+/*
+ * String#unpack, String#unpack1
+ */
+
+struct unpack_out {
+    mrbc_value ary;     /* unpack: result Array */
+    mrbc_value first;   /* unpack1: first value */
+    int single;
+    int done;
+};
+
+/* Raises and returns -1 if the Array cannot grow */
+static int unpack_push(mrbc_vm *vm, struct unpack_out *out, mrbc_value val)
+{
+    if (out->single) {
+        out->first = val;
+        out->done = 1;
+    } else if (mrbc_array_push(&out->ary, &val) != 0) {
+        mrbc_decref(&val);
+        return pack_nomem(vm);
+    }
+    return 0;
+}
+
+static uint64_t load_uint(const uint8_t *p, int size, int big_endian)
+{
+    uint64_t x = 0;
+    for (int i = 0; i < size; i++) {
+        x = (x << 8) | p[big_endian ? i : size - 1 - i];
+    }
+    return x;
+}
+
+/*
+ * Decode one number into *val. A value that does not fit in mrbc_int_t
+ * (N, L or Q above the 32-bit range) becomes a Float; without Float
+ * support it raises RangeError and returns -1.
+ */
+static int unpack_number(mrbc_vm *vm, const struct pack_op *op, const uint8_t *p,
+                         mrbc_value *val)
+{
+    uint64_t x = load_uint(p, op->size, op->big_endian);
+
+#if MRBC_USE_FLOAT
+    if (op->type == PM_PACK_FLOAT) {
+        if (op->size == 4) {
+            uint32_t u = (uint32_t)x;
+            float f;
+            memcpy(&f, &u, 4);
+            *val = mrbc_float_value(vm, f);
+            return 0;
+        }
+        double d;
+        memcpy(&d, &x, 8);
+        *val = mrbc_float_value(vm, d);
+        return 0;
+    }
+#endif
+
+    if (op->is_signed && op->size < 8 && (x & (1ULL << (op->size * 8 - 1)))) {
+        x |= ~0ULL << (op->size * 8);
+    }
+
+    mrbc_int_t i = (mrbc_int_t)(int64_t)x;
+    if (op->is_signed ? (int64_t)i == (int64_t)x : i >= 0 && (uint64_t)i == x) {
+        *val = mrbc_integer_value(i);
+        return 0;
+    }
+#if MRBC_USE_FLOAT
+    *val = mrbc_float_value(vm, op->is_signed ? (double)(int64_t)x : (double)x);
+    return 0;
+#else
+    mrbc_raise(vm, MRBC_CLASS(RangeError), "unpacked integer out of range");
+    return -1;
+#endif
+}
+
+/* Decode one UTF-8 character; returns its length, or 0 if malformed */
+static int utf8_decode(const uint8_t *p, size_t len, uint32_t *c)
+{
+    int n = (p[0] < 0x80) ? 1 : (p[0] & 0xe0) == 0xc0 ? 2 :
+            (p[0] & 0xf0) == 0xe0 ? 3 : (p[0] & 0xf8) == 0xf0 ? 4 : 0;
+    if (n == 0 || (size_t)n > len) {
+        return 0;
+    }
+
+    *c = (n == 1) ? p[0] : p[0] & (0x3f >> (n - 1));
+    for (int i = 1; i < n; i++) {
+        if ((p[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *c = (*c << 6) | (p[i] & 0x3f);
+    }
+    return n;
+}
+
+static mrbc_value unpack_bits(mrbc_vm *vm, const struct pack_op *op, const uint8_t *p,
+                              size_t avail, size_t *used)
+{
+    int hex = (op->type == PM_PACK_STRING_HEX_HIGH || op->type == PM_PACK_STRING_HEX_LOW);
+    size_t per_byte = hex ? 2 : 8;
+    size_t n = avail * per_byte;
+    if (!op->star && op->count < n) {
+        n = op->count;
+    }
+    *used = (n + per_byte - 1) / per_byte;
+
+    mrbc_value str = mrbc_string_new(vm, NULL, n);
+    if (str.tt != MRBC_TT_STRING || !str.string) {
+        return str;
+    }
+
+    uint8_t *s = str.string->data;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t byte = p[i / per_byte];
+        switch (op->type) {
+        case PM_PACK_STRING_MSB:
+            s[i] = '0' + ((byte >> (7 - i % 8)) & 1);
+            break;
+        case PM_PACK_STRING_LSB:
+            s[i] = '0' + ((byte >> (i % 8)) & 1);
+            break;
+        default: {
+            int high = (op->type == PM_PACK_STRING_HEX_HIGH) == (i % 2 == 0);
+            s[i] = "0123456789abcdef"[(high ? byte >> 4 : byte) & 15];
+            break;
+        }
+        }
+    }
+    s[n] = '\0';
+    return str;
+}
+
+/* Unpack one operation at *pos; raises and returns -1 on error */
+static int unpack_op(mrbc_vm *vm, const struct pack_op *op, const uint8_t *src,
+                     size_t len, size_t *pos, struct unpack_out *out)
+{
+    const uint8_t *p = src + *pos;
+    size_t avail = len - *pos;
+    mrbc_value val;
+
+    switch (op->type) {
+    case PM_PACK_INTEGER:
+    case PM_PACK_FLOAT: {
+        uint32_t count = op->star ? (uint32_t)(avail / op->size) : op->count;
+        for (uint32_t i = 0; i < count && !out->done; i++) {
+            if (*pos + op->size > len) {
+                if (unpack_push(vm, out, mrbc_nil_value()) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            if (unpack_number(vm, op, src + *pos, &val) < 0) {
+                return -1;
+            }
+            if (unpack_push(vm, out, val) < 0) {
+                return -1;
+            }
+            *pos += op->size;
+        }
+        return 0;
+    }
+
+    case PM_PACK_UTF8: {
+        for (uint32_t i = 0; (op->star || i < op->count) && *pos < len && !out->done; i++) {
+            uint32_t c;
+            int n = utf8_decode(src + *pos, len - *pos, &c);
+            if (n == 0) {
+                mrbc_raise(vm, MRBC_CLASS(ArgumentError), "malformed UTF-8 character");
+                return -1;
+            }
+            if (unpack_push(vm, out, mrbc_integer_value(c)) < 0) {
+                return -1;
+            }
+            *pos += n;
+        }
+        return 0;
+    }
+
+    case PM_PACK_STRING_SPACE_PADDED:
+    case PM_PACK_STRING_NULL_PADDED:
+    case PM_PACK_STRING_NULL_TERMINATED: {
+        size_t n = (op->star || op->count > avail) ? avail : op->count;
+        size_t used = n;
+        if (op->type == PM_PACK_STRING_NULL_TERMINATED) {
+            const uint8_t *nul = memchr(p, 0, n);
+            if (nul) {
+                n = nul - p;
+                if (op->star) {
+                    used = n + 1;
+                }
+            }
+        } else if (op->type == PM_PACK_STRING_SPACE_PADDED) {
+            while (n > 0 && (p[n - 1] == ' ' || p[n - 1] == '\0')) {
+                n--;
+            }
+        }
+        val = mrbc_string_new(vm, p, n);
+        *pos += used;
+        break;
+    }
+
+    case PM_PACK_STRING_MSB:
+    case PM_PACK_STRING_LSB:
+    case PM_PACK_STRING_HEX_HIGH:
+    case PM_PACK_STRING_HEX_LOW: {
+        size_t used;
+        val = unpack_bits(vm, op, p, avail, &used);
+        *pos += used;
+        break;
+    }
+
+    case PM_PACK_NULL:
+        if (op->star) {
+            *pos = len;
+        } else if (op->count > avail) {
+            mrbc_raise(vm, MRBC_CLASS(ArgumentError), "x outside of string");
+            return -1;
+        } else {
+            *pos += op->count;
+        }
+        return 0;
+
+    case PM_PACK_BACK:
+        if (!op->star && op->count > *pos) {
+            mrbc_raise(vm, MRBC_CLASS(ArgumentError), "X outside of string");
+            return -1;
+        }
+        *pos -= op->star ? 0 : op->count;
+        return 0;
+
+    case PM_PACK_MOVE:
+        if (op->count > len) {
+            mrbc_raise(vm, MRBC_CLASS(ArgumentError), "@ outside of string");
+            return -1;
+        }
+        *pos = op->count;
+        return 0;
+
+    default:
+        return 0;
+    }
+
+    if (val.tt != MRBC_TT_STRING || !val.string) {
+        return pack_nomem(vm);
+    }
+    return unpack_push(vm, out, val);
+}
+
+static void unpack(mrbc_vm *vm, mrbc_value *v, int argc, int single)
+{
+    if (argc != 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+
+    const struct pack_template *t = pack_template_get(vm, &v[1], PM_PACK_VARIANT_UNPACK);
+    if (!t) {
+        return;
+    }
+
+    const uint8_t *src = v[0].string->data;
+    size_t len = v[0].string->size;
+    size_t pos = 0;
+
+    struct unpack_out out;
+    out.single = single;
+    out.done = 0;
+    out.first = mrbc_nil_value();
+    if (!single) {
+        out.ary = mrbc_array_new(vm, t->n_ops);
+        if (out.ary.tt != MRBC_TT_ARRAY || !out.ary.array) {
+            pack_nomem(vm);
+            return;
+        }
+    }
+
+    for (int i = 0; i < t->n_ops && !out.done; i++) {
+        if (unpack_op(vm, &t->ops[i], src, len, &pos, &out) < 0) {
+            if (!single) {
+                mrbc_decref(&out.ary);
+            }
+            return;
+        }
+    }
+
+    if (single) {
+        SET_RETURN(out.first);
+    } else {
+        SET_RETURN(out.ary);
+    }
+}
+
+/**
+ * string.unpack(template) -> Array
+ */
+static void c_string_unpack(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    unpack(vm, v, argc, 0);
+}
+
+/**
+ * string.unpack1(template) -> Object
+ *
+ * Same as unpack(template)[0], without building the Array.
+ */
+static void c_string_unpack1(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    unpack(vm, v, argc, 1);
+}
+
+/**
+ * Initialize the pack extension
+ */
+void mrbc_pack_init(void)
+{
+    mrbc_define_method(0, MRBC_CLASS(Array), "pack", c_array_pack);
+    mrbc_define_method(0, MRBC_CLASS(String), "unpack", c_string_unpack);
+    mrbc_define_method(0, MRBC_CLASS(String), "unpack1", c_string_unpack1);
+
+    LOG_DBG("Array#pack, String#unpack registered");
+}
+
+HAKO_EXTENSION_DEFINE(pack, mrbc_pack_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
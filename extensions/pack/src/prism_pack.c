@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file prism_pack.c
+ * @brief Prism's pack template parser, built for the pack extension
+ *
+ * CONFIG_HAKO_COMPILER_OPTIMIZE_SIZE sets PRISM_BUILD_MINIMAL for the
+ * whole library, which stubs out pm_pack_parse(). The parser is built
+ * here without that switch; the top-level CMakeLists.txt leaves Prism's
+ * own pack.c out when this extension is enabled.
+ */
+
+#undef PRISM_BUILD_MINIMAL
+#undef PRISM_EXCLUDE_PACK
+
+#include "../../../ext/picoruby/mruby-compiler2/lib/prism/src/pack.c"
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file hako_re.h
+ * @brief Regexp compiler and Pike VM matcher
+ *
+ * Patterns compile to a small bytecode program that is matched by a
+ * Pike VM: all threads advance in lockstep over the input, so matching
+ * time is linear in the input length and memory is bounded by the
+ * program size. There is no backtracking, hence no backreferences or
+ * lookaround.
+ *
+ * The engine does not depend on the VM; the on-device compiler uses
+ * hako_re_compile() to store compiled regexp literals in the irep pool.
+ */
+
+#ifndef HAKO_RE_H
+#define HAKO_RE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Option bits, same values as Regexp::IGNORECASE etc. */
+#define HAKO_RE_IGNORECASE 1
+#define HAKO_RE_EXTENDED   2
+#define HAKO_RE_MULTILINE  4
+
+/** Capture groups a pattern may have, not counting the whole match */
+#define HAKO_RE_MAX_GROUPS 15
+
+/** Instructions a program may have */
+#define HAKO_RE_MAX_INST   1024
+
+/** Character classes a program may have (32 bytes each) */
+#define HAKO_RE_MAX_CLASSES 16
+
+/** Largest program hako_re_compile() can produce */
+#define HAKO_RE_PROGRAM_MAX (8 + 4 * HAKO_RE_MAX_INST + 32 * HAKO_RE_MAX_CLASSES)
+
+/**
+ * @brief Compile a pattern
+ *
+ * @param src Pattern text (not NUL-terminated)
+ * @param len Length of src
+ * @param flags HAKO_RE_* option bits
+ * @param out Program buffer
+ * @param size Size of out; HAKO_RE_PROGRAM_MAX always suffices
+ * @param err Set to a message on failure
+ * @return Program length in bytes, or -1 on error
+ */
+int hako_re_compile(const char *src, size_t len, int flags,
+                    uint8_t *out, size_t size, const char **err);
+
+/**
+ * @brief Check that a program is well formed
+ *
+ * Programs loaded from bytecode are checked once before use, so a
+ * corrupted pool entry cannot make the matcher read out of bounds.
+ *
+ * @return 0 if valid, -1 otherwise
+ */
+int hako_re_check(const uint8_t *prog, size_t len);
+
+/** @brief Number of capture groups, not counting the whole match */
+int hako_re_groups(const uint8_t *prog);
+
+/** @brief Option bits the program was compiled with */
+int hako_re_flags(const uint8_t *prog);
+
+/** @brief Work area size hako_re_exec() needs for this program */
+size_t hako_re_work_size(const uint8_t *prog);
+
+/**
+ * @brief Search for the leftmost match at or after start
+ *
+ * @param prog Compiled program
+ * @param s Subject
+ * @param len Length of s
+ * @param start Offset to start searching from
+ * @param caps Receives 2 * (groups + 1) offsets, -1 for unset groups
+ * @param work Work area of hako_re_work_size() bytes, 4-byte aligned
+ * @return 1 if matched, 0 if not
+ */
+int hako_re_exec(const uint8_t *prog, const uint8_t *s, size_t len, size_t start,
+                 int32_t *caps, void *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAKO_RE_H */
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file regexp_ext.h
+ * @brief Regexp extension public API
+ */
+
+#ifndef REGEXP_EXT_H
+#define REGEXP_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the regexp extension
+ *
+ * Registers Regexp, MatchData, RegexpError and the String methods that
+ * take a pattern with the mruby/c VM. Called automatically by HAKO
+ * loader during initialization.
+ */
+void mrbc_regexp_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* REGEXP_EXT_H */
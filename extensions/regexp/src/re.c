@@ -0,0 +1,1083 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file re.c
+ * @brief Regexp compiler and Pike VM matcher
+ *
+ * Program layout (little endian):
+ *   [0] 'R'  [1] version  [2] flags  [3] groups
+ *   [4..5] instructions  [6] classes  [7] 0
+ *   instructions, 4 bytes each: op, arg, x (u16)
+ *   classes, 32-byte bitmaps
+ *
+ * Every program starts with SAVE 0 and ends with SAVE 1, MATCH.
+ */
+
+#include "hako_re.h"
+
+#include <string.h>
+
+#define RE_MAGIC   'R'
+#define RE_VERSION 1
+#define RE_HEADER  8
+
+/* Parser nesting limit, bounds the compiler's stack use */
+#define RE_MAX_DEPTH 32
+
+enum {
+    RE_CHAR,    /* arg: byte */
+    RE_CHARI,   /* arg: lower case letter, matches either case */
+    RE_ANY,     /* any byte but '\n' */
+    RE_ANYNL,   /* any byte */
+    RE_CLASS,   /* arg: class index */
+    RE_CONTS,   /* zero or more UTF-8 continuation bytes */
+    RE_MATCH,
+    RE_JMP,     /* x: target */
+    RE_SPLIT,   /* pc + 1 first, then x */
+    RE_RSPLIT,  /* x first, then pc + 1 */
+    RE_SAVE,    /* arg: capture slot */
+    RE_ASSERT,  /* arg: RE_AT_* */
+    RE_NUM_OPS
+};
+
+enum {
+    RE_AT_BOL,
+    RE_AT_EOL,
+    RE_AT_BOT,
+    RE_AT_EOT,
+    RE_AT_EOTNL,
+    RE_AT_WORDB,
+    RE_AT_NWORDB,
+    RE_NUM_ATS
+};
+
+#define INST(code, pc) ((code) + 4 * (pc))
+#define OP(code, pc)   (INST(code, pc)[0])
+#define ARG(code, pc)  (INST(code, pc)[1])
+#define X(code, pc)    (INST(code, pc)[2] | (INST(code, pc)[3] << 8))
+
+static int is_jump(int op)
+{
+    return op == RE_JMP || op == RE_SPLIT || op == RE_RSPLIT;
+}
+
+static void set_x(uint8_t *code, int pc, int x)
+{
+    INST(code, pc)[2] = (uint8_t)x;
+    INST(code, pc)[3] = (uint8_t)(x >> 8);
+}
+
+static int is_word(int c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+           (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80;
+}
+
+static int to_lower(int c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+}
+
+/*
+ * Compiler
+ */
+
+struct re_compiler {
+    const char *p;
+    const char *end;
+    int flags;
+    uint8_t *code;
+    int max_inst;
+    int n;
+    int groups;
+    int depth;
+    int nclass;
+    uint8_t classes[HAKO_RE_MAX_CLASSES][32];
+    const char *err;
+};
+
+static int fail(struct re_compiler *c, const char *msg)
+{
+    if (!c->err) {
+        c->err = msg;
+    }
+    return -1;
+}
+
+static int emit(struct re_compiler *c, int op, int arg, int x)
+{
+    if (c->n >= c->max_inst) {
+        return fail(c, "regexp too large");
+    }
+    uint8_t *i = INST(c->code, c->n);
+    i[0] = op;
+    i[1] = arg;
+    i[2] = (uint8_t)x;
+    i[3] = (uint8_t)(x >> 8);
+    return c->n++;
+}
+
+/*
+ * Insert an instruction at pc, moving the rest up. Jumps into the moved
+ * code follow it; jumps from before pc that targeted pc now reach the
+ * new instruction.
+ */
+static int insert(struct re_compiler *c, int pc, int op, int arg)
+{
+    if (c->n >= c->max_inst) {
+        return fail(c, "regexp too large");
+    }
+    memmove(INST(c->code, pc + 1), INST(c->code, pc), 4 * (c->n - pc));
+    c->n++;
+    for (int i = 0; i < c->n; i++) {
+        if (i != pc && is_jump(OP(c->code, i))) {
+            int x = X(c->code, i);
+            if (x > pc || (x == pc && i > pc)) {
+                set_x(c->code, i, x + 1);
+            }
+        }
+    }
+    uint8_t *i = INST(c->code, pc);
+    i[0] = op;
+    i[1] = arg;
+    i[2] = i[3] = 0;
+    return pc;
+}
+
+/* Append a copy of [s, e), moving jumps within it along */
+static int append_copy(struct re_compiler *c, int s, int e)
+{
+    int delta = c->n - s;
+    for (int i = s; i < e; i++) {
+        int op = OP(c->code, i);
+        int x = X(c->code, i);
+        if (is_jump(op) && x >= s && x <= e) {
+            x += delta;
+        }
+        if (emit(c, op, ARG(c->code, i), x) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int add_class(struct re_compiler *c, const uint8_t *bits)
+{
+    for (int i = 0; i < c->nclass; i++) {
+        if (memcmp(c->classes[i], bits, 32) == 0) {
+            return i;
+        }
+    }
+    if (c->nclass == HAKO_RE_MAX_CLASSES) {
+        return fail(c, "too many character classes");
+    }
+    memcpy(c->classes[c->nclass], bits, 32);
+    return c->nclass++;
+}
+
+static void bit_set(uint8_t *bits, int ch)
+{
+    bits[ch >> 3] |= 1 << (ch & 7);
+}
+
+static void bit_range(uint8_t *bits, int lo, int hi)
+{
+    for (int ch = lo; ch <= hi; ch++) {
+        bit_set(bits, ch);
+    }
+}
+
+/* Add the set for \d \w \s \h (lower case letter) to bits */
+static void add_shorthand(uint8_t *bits, int kind)
+{
+    uint8_t set[32] = { 0 };
+
+    switch (to_lower(kind)) {
+    case 'd':
+        bit_range(set, '0', '9');
+        break;
+    case 'w':
+        bit_range(set, '0', '9');
+        bit_range(set, 'a', 'z');
+        bit_range(set, 'A', 'Z');
+        bit_set(set, '_');
+        break;
+    case 's':
+        bit_range(set, '\t', '\r');
+        bit_set(set, ' ');
+        break;
+    case 'h':
+        bit_range(set, '0', '9');
+        bit_range(set, 'a', 'f');
+        bit_range(set, 'A', 'F');
+        break;
+    }
+    for (int i = 0; i < 32; i++) {
+        bits[i] |= (kind >= 'A' && kind <= 'Z') ? (uint8_t)~set[i] : set[i];
+    }
+}
+
+static int is_shorthand(int ch)
+{
+    return strchr("dDwWsShH", ch) != NULL && ch != 0;
+}
+
+/*
+ * Emit a class, folding case before negating. Negated sets also take the
+ * rest of a UTF-8 character.
+ */
+static int emit_class(struct re_compiler *c, uint8_t *bits, int negated)
+{
+    if (c->flags & HAKO_RE_IGNORECASE) {
+        for (int ch = 'a'; ch <= 'z'; ch++) {
+            if (bits[ch >> 3] & (1 << (ch & 7))) {
+                bit_set(bits, ch - 32);
+            }
+            if (bits[(ch - 32) >> 3] & (1 << ((ch - 32) & 7))) {
+                bit_set(bits, ch);
+            }
+        }
+    }
+    if (negated) {
+        for (int i = 0; i < 32; i++) {
+            bits[i] = ~bits[i];
+        }
+    }
+    int k = add_class(c, bits);
+    if (k < 0 || emit(c, RE_CLASS, k, 0) < 0) {
+        return -1;
+    }
+    return negated ? emit(c, RE_CONTS, 0, 0) : 0;
+}
+
+/* Parse an escape after '\'; returns the byte, or -1 on error */
+static int parse_char_escape(struct re_compiler *c)
+{
+    int ch = (unsigned char)*c->p++;
+
+    switch (ch) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case 'a': return 7;
+    case 'e': return 27;
+    case '0': return 0;
+    case 'x': {
+        int v = 0;
+        int digits = 0;
+        while (digits < 2 && c->p < c->end) {
+            int d = to_lower((unsigned char)*c->p);
+            if (d >= '0' && d <= '9') {
+                d -= '0';
+            } else if (d >= 'a' && d <= 'f') {
+                d -= 'a' - 10;
+            } else {
+                break;
+            }
+            v = v * 16 + d;
+            c->p++;
+            digits++;
+        }
+        return digits ? v : fail(c, "invalid hex escape");
+    }
+    }
+    if (ch >= '1' && ch <= '9') {
+        return fail(c, "backreferences are not supported");
+    }
+    if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')) {
+        return fail(c, "unsupported escape");
+    }
+    return ch;
+}
+
+static const struct {
+    const char *name;
+    const char *spec;   /* ranges as pairs */
+} posix_classes[] = {
+    { "alpha", "azAZ" },
+    { "digit", "09" },
+    { "alnum", "azAZ09" },
+    { "upper", "AZ" },
+    { "lower", "az" },
+    { "xdigit", "09afAF" },
+    { "space", "\t\r  " },
+    { "word", "azAZ09__" },
+    { "punct", "!/:@[`{~" },
+};
+
+static int parse_posix_class(struct re_compiler *c, uint8_t *bits)
+{
+    const char *close = c->p + 2;
+    while (close + 1 < c->end && !(close[0] == ':' && close[1] == ']')) {
+        close++;
+    }
+    if (close + 1 >= c->end) {
+        return fail(c, "premature end of char-class");
+    }
+
+    size_t len = close - (c->p + 2);
+    for (size_t i = 0; i < sizeof(posix_classes) / sizeof(posix_classes[0]); i++) {
+        if (strlen(posix_classes[i].name) == len &&
+            memcmp(posix_classes[i].name, c->p + 2, len) == 0) {
+            for (const char *r = posix_classes[i].spec; *r; r += 2) {
+                bit_range(bits, r[0], r[1]);
+            }
+            c->p = close + 2;
+            return 0;
+        }
+    }
+    return fail(c, "invalid POSIX bracket type");
+}
+
+static int parse_class(struct re_compiler *c)
+{
+    uint8_t bits[32] = { 0 };
+    int negated = 0;
+    int first = 1;
+
+    if (c->p < c->end && *c->p == '^') {
+        negated = 1;
+        c->p++;
+    }
+
+    for (;;) {
+        if (c->p >= c->end) {
+            return fail(c, "premature end of char-class");
+        }
+        int ch = (unsigned char)*c->p;
+        if (ch == ']' && !first) {
+            c->p++;
+            break;
+        }
+        first = 0;
+
+        if (ch == '[') {
+            if (c->p + 1 < c->end && c->p[1] == ':') {
+                if (parse_posix_class(c, bits) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            return fail(c, "nested character classes are not supported");
+        }
+        if (ch == '&' && c->p + 1 < c->end && c->p[1] == '&') {
+            return fail(c, "class intersection is not supported");
+        }
+
+        c->p++;
+        if (ch == '\\') {
+            if (c->p >= c->end) {
+                return fail(c, "premature end of char-class");
+            }
+            if (is_shorthand(*c->p)) {
+                add_shorthand(bits, *c->p++);
+                continue;
+            }
+            if ((ch = parse_char_escape(c)) < 0) {
+                return -1;
+            }
+        }
+        if (ch >= 0x80) {
+            return fail(c, "non-ASCII characters in a class are not supported");
+        }
+
+        int hi = ch;
+        if (c->p + 1 < c->end && c->p[0] == '-' && c->p[1] != ']') {
+            c->p++;
+            hi = (unsigned char)*c->p++;
+            if (hi == '\\') {
+                if (c->p >= c->end || (hi = parse_char_escape(c)) < 0) {
+                    return fail(c, "premature end of char-class");
+                }
+            }
+            if (hi >= 0x80) {
+                return fail(c, "non-ASCII characters in a class are not supported");
+            }
+            if (hi < ch) {
+                return fail(c, "empty range in char class");
+            }
+        }
+        bit_range(bits, ch, hi);
+    }
+
+    return emit_class(c, bits, negated);
+}
+
+static void skip_extended(struct re_compiler *c)
+{
+    if (!(c->flags & HAKO_RE_EXTENDED)) {
+        return;
+    }
+    while (c->p < c->end) {
+        if (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r') {
+            c->p++;
+        } else if (*c->p == '#') {
+            while (c->p < c->end && *c->p != '\n') {
+                c->p++;
+            }
+        } else {
+            break;
+        }
+    }
+}
+
+static int parse_alt(struct re_compiler *c);
+
+static int parse_group(struct re_compiler *c)
+{
+    int group = -1;
+
+    if (c->p < c->end && *c->p == '?') {
+        c->p++;
+        if (c->p < c->end && *c->p == ':') {
+            c->p++;
+        } else if (c->p + 1 < c->end && (*c->p == '<' || *c->p == '\'') &&
+                   c->p[1] != '=' && c->p[1] != '!') {
+            /* named group: numbered like any other capture */
+            char close = (*c->p == '<') ? '>' : '\'';
+            while (c->p < c->end && *c->p != close) {
+                c->p++;
+            }
+            if (c->p >= c->end) {
+                return fail(c, "invalid group name");
+            }
+            c->p++;
+            group = 0;
+        } else {
+            return fail(c, "unsupported group (lookaround, atomic or inline options)");
+        }
+    } else {
+        group = 0;
+    }
+
+    if (group == 0) {
+        if (c->groups == HAKO_RE_MAX_GROUPS) {
+            return fail(c, "too many capture groups");
+        }
+        group = ++c->groups;
+        if (emit(c, RE_SAVE, 2 * group, 0) < 0) {
+            return -1;
+        }
+    }
+
+    if (parse_alt(c) < 0) {
+        return -1;
+    }
+    if (c->p >= c->end || *c->p != ')') {
+        return fail(c, "end pattern with unmatched parenthesis");
+    }
+    c->p++;
+
+    if (group > 0) {
+        return emit(c, RE_SAVE, 2 * group + 1, 0);
+    }
+    return 0;
+}
+
+static int parse_atom(struct re_compiler *c)
+{
+    int ch = (unsigned char)*c->p++;
+
+    switch (ch) {
+    case '(':
+        return parse_group(c);
+    case '[':
+        return parse_class(c);
+    case '.':
+        if (emit(c, (c->flags & HAKO_RE_MULTILINE) ? RE_ANYNL : RE_ANY, 0, 0) < 0) {
+            return -1;
+        }
+        return emit(c, RE_CONTS, 0, 0);
+    case '^':
+        return emit(c, RE_ASSERT, RE_AT_BOL, 0);
+    case '$':
+        return emit(c, RE_ASSERT, RE_AT_EOL, 0);
+    case '*':
+    case '+':
+    case '?':
+        return fail(c, "target of repeat operator is not specified");
+    case '\\':
+        break;
+    default:
+        goto literal;
+    }
+
+    if (c->p >= c->end) {
+        return fail(c, "too short escape sequence");
+    }
+    ch = (unsigned char)*c->p;
+    if (is_shorthand(ch)) {
+        uint8_t bits[32] = { 0 };
+        c->p++;
+        add_shorthand(bits, to_lower(ch));
+        return emit_class(c, bits, ch >= 'A' && ch <= 'Z');
+    }
+    switch (ch) {
+    case 'A': c->p++; return emit(c, RE_ASSERT, RE_AT_BOT, 0);
+    case 'z': c->p++; return emit(c, RE_ASSERT, RE_AT_EOT, 0);
+    case 'Z': c->p++; return emit(c, RE_ASSERT, RE_AT_EOTNL, 0);
+    case 'b': c->p++; return emit(c, RE_ASSERT, RE_AT_WORDB, 0);
+    case 'B': c->p++; return emit(c, RE_ASSERT, RE_AT_NWORDB, 0);
+    }
+    if ((ch = parse_char_escape(c)) < 0) {
+        return -1;
+    }
+
+literal:
+    if (ch >= 0xc0) {
+        /* a multibyte character is one atom */
+        if (emit(c, RE_CHAR, ch, 0) < 0) {
+            return -1;
+        }
+        while (c->p < c->end && ((unsigned char)*c->p & 0xc0) == 0x80) {
+            if (emit(c, RE_CHAR, (unsigned char)*c->p++, 0) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    if ((c->flags & HAKO_RE_IGNORECASE) && to_lower(ch) >= 'a' && to_lower(ch) <= 'z') {
+        return emit(c, RE_CHARI, to_lower(ch), 0);
+    }
+    return emit(c, RE_CHAR, ch, 0);
+}
+
+/* Parse {n}, {n,}, {,m} or {n,m}; returns 0 and leaves p alone if not one */
+static int parse_count(struct re_compiler *c, int *min, int *max)
+{
+    const char *p = c->p + 1;
+    int lo = -1;
+    int hi = -1;
+
+    for (int *v = &lo; ; v = &hi) {
+        while (p < c->end && *p >= '0' && *p <= '9') {
+            *v = (*v < 0 ? 0 : *v) * 10 + (*p++ - '0');
+            if (*v > 1000) {
+                return fail(c, "too big number for repeat range");
+            }
+        }
+        if (v == &hi || p >= c->end || *p != ',') {
+            break;
+        }
+        p++;
+        if (lo < 0) {
+            lo = 0;
+        }
+        hi = -2;    /* comma seen */
+        if (p < c->end && *p >= '0' && *p <= '9') {
+            hi = -1;
+        }
+        if (hi == -2) {
+            break;
+        }
+    }
+
+    if (p >= c->end || *p != '}' || lo < 0) {
+        return 0;
+    }
+    *min = lo;
+    *max = (hi == -2) ? -1 : (hi < 0 ? lo : hi);
+    if (*max >= 0 && *max < *min) {
+        return fail(c, "upper bound must be greater than lower bound");
+    }
+    c->p = p + 1;
+    return 1;
+}
+
+static int apply_repeat(struct re_compiler *c, int s, int min, int max, int greedy)
+{
+    int e = c->n;
+    int split = greedy ? RE_SPLIT : RE_RSPLIT;
+    int pending[HAKO_RE_MAX_INST > 64 ? 64 : HAKO_RE_MAX_INST];
+    int npending = 0;
+
+    if (e == s) {
+        return 0;
+    }
+
+    if (min == 0 && max == 1) {
+        if (insert(c, s, split, 0) < 0) {
+            return -1;
+        }
+        set_x(c->code, s, c->n);
+        return 0;
+    }
+    if (min == 0 && max < 0) {
+        if (insert(c, s, split, 0) < 0 || emit(c, RE_JMP, 0, s) < 0) {
+            return -1;
+        }
+        set_x(c->code, s, c->n);
+        return 0;
+    }
+    if (min == 0 && max == 0) {
+        c->n = s;
+        return 0;
+    }
+
+    int bs = s;
+    int be = e;
+    if (min == 0) {
+        if (insert(c, s, split, 0) < 0) {
+            return -1;
+        }
+        pending[npending++] = s;
+        bs = s + 1;
+        be = e + 1;
+        min = 1;
+        max--;
+    } else {
+        max = (max < 0) ? -1 : max - min;
+    }
+
+    int last = bs;
+    for (int i = 1; i < min; i++) {
+        last = c->n;
+        if (append_copy(c, bs, be) < 0) {
+            return -1;
+        }
+    }
+
+    if (max < 0) {
+        /* last copy loops, as for '+' */
+        return emit(c, greedy ? RE_RSPLIT : RE_SPLIT, 0, last);
+    }
+
+    for (int i = 0; i < max; i++) {
+        if (npending == (int)(sizeof(pending) / sizeof(pending[0]))) {
+            return fail(c, "too big number for repeat range");
+        }
+        int pc = emit(c, split, 0, 0);
+        if (pc < 0 || append_copy(c, bs, be) < 0) {
+            return -1;
+        }
+        pending[npending++] = pc;
+    }
+    for (int i = 0; i < npending; i++) {
+        set_x(c->code, pending[i], c->n);
+    }
+    return 0;
+}
+
+static int parse_seq(struct re_compiler *c)
+{
+    for (;;) {
+        skip_extended(c);
+        if (c->p >= c->end || *c->p == '|' || *c->p == ')') {
+            return 0;
+        }
+
+        int s = c->n;
+        if (parse_atom(c) < 0) {
+            return -1;
+        }
+
+        skip_extended(c);
+        if (c->p >= c->end) {
+            return 0;
+        }
+
+        int min, max;
+        switch (*c->p) {
+        case '*': min = 0; max = -1; c->p++; break;
+        case '+': min = 1; max = -1; c->p++; break;
+        case '?': min = 0; max = 1; c->p++; break;
+        case '{':
+            if (parse_count(c, &min, &max) <= 0) {
+                if (c->err) {
+                    return -1;
+                }
+                continue;
+            }
+            break;
+        default:
+            continue;
+        }
+
+        int greedy = 1;
+        if (c->p < c->end && *c->p == '?') {
+            greedy = 0;
+            c->p++;
+        } else if (c->p < c->end && *c->p == '+') {
+            return fail(c, "possessive quantifiers are not supported");
+        }
+        if (apply_repeat(c, s, min, max, greedy) < 0) {
+            return -1;
+        }
+    }
+}
+
+static int parse_alt(struct re_compiler *c)
+{
+    int jumps[32];
+    int njumps = 0;
+    int alt_start = c->n;
+
+    if (++c->depth > RE_MAX_DEPTH) {
+        return fail(c, "regexp nested too deeply");
+    }
+
+    for (;;) {
+        if (parse_seq(c) < 0) {
+            return -1;
+        }
+        if (c->p >= c->end || *c->p != '|') {
+            break;
+        }
+        c->p++;
+
+        if (njumps == (int)(sizeof(jumps) / sizeof(jumps[0]))) {
+            return fail(c, "too many alternatives");
+        }
+        if (insert(c, alt_start, RE_SPLIT, 0) < 0) {
+            return -1;
+        }
+        int j = emit(c, RE_JMP, 0, 0);
+        if (j < 0) {
+            return -1;
+        }
+        jumps[njumps++] = j;
+        set_x(c->code, alt_start, c->n);
+        alt_start = c->n;
+    }
+
+    for (int i = 0; i < njumps; i++) {
+        set_x(c->code, jumps[i], c->n);
+    }
+    c->depth--;
+    return 0;
+}
+
+int hako_re_compile(const char *src, size_t len, int flags,
+                    uint8_t *out, size_t size, const char **err)
+{
+    struct re_compiler c;
+
+    memset(&c, 0, sizeof(c));
+    c.p = src;
+    c.end = src + len;
+    c.flags = flags & (HAKO_RE_IGNORECASE | HAKO_RE_EXTENDED | HAKO_RE_MULTILINE);
+    c.code = out + RE_HEADER;
+    c.max_inst = (size < RE_HEADER) ? 0 : (int)((size - RE_HEADER) / 4);
+    if (c.max_inst > HAKO_RE_MAX_INST) {
+        c.max_inst = HAKO_RE_MAX_INST;
+    }
+
+    if (emit(&c, RE_SAVE, 0, 0) >= 0 && parse_alt(&c) >= 0) {
+        if (c.p < c.end) {
+            fail(&c, "unmatched close parenthesis");
+        }
+        emit(&c, RE_SAVE, 1, 0);
+        emit(&c, RE_MATCH, 0, 0);
+    }
+
+    size_t total = RE_HEADER + 4 * (size_t)c.n + 32 * (size_t)c.nclass;
+    if (!c.err && total > size) {
+        fail(&c, "regexp too large");
+    }
+    if (c.err) {
+        *err = c.err;
+        return -1;
+    }
+
+    out[0] = RE_MAGIC;
+    out[1] = RE_VERSION;
+    out[2] = c.flags;
+    out[3] = c.groups;
+    out[4] = (uint8_t)c.n;
+    out[5] = (uint8_t)(c.n >> 8);
+    out[6] = c.nclass;
+    out[7] = 0;
+    memcpy(out + RE_HEADER + 4 * c.n, c.classes, 32 * c.nclass);
+    return (int)total;
+}
+
+/*
+ * Program access
+ */
+
+static int prog_ninst(const uint8_t *prog)
+{
+    return prog[4] | (prog[5] << 8);
+}
+
+int hako_re_groups(const uint8_t *prog)
+{
+    return prog[3];
+}
+
+int hako_re_flags(const uint8_t *prog)
+{
+    return prog[2];
+}
+
+int hako_re_check(const uint8_t *prog, size_t len)
+{
+    if (len < RE_HEADER || prog[0] != RE_MAGIC || prog[1] != RE_VERSION ||
+        prog[3] > HAKO_RE_MAX_GROUPS || prog[6] > HAKO_RE_MAX_CLASSES) {
+        return -1;
+    }
+
+    int n = prog_ninst(prog);
+    int ncap = 2 * (prog[3] + 1);
+    if (n < 1 || n > HAKO_RE_MAX_INST || len != RE_HEADER + 4 * (size_t)n + 32 * (size_t)prog[6]) {
+        return -1;
+    }
+
+    const uint8_t *code = prog + RE_HEADER;
+    for (int pc = 0; pc < n; pc++) {
+        int op = OP(code, pc);
+        if (op >= RE_NUM_OPS ||
+            (is_jump(op) && X(code, pc) >= n) ||
+            (op == RE_CLASS && ARG(code, pc) >= prog[6]) ||
+            (op == RE_SAVE && ARG(code, pc) >= ncap) ||
+            (op == RE_ASSERT && ARG(code, pc) >= RE_NUM_ATS) ||
+            (pc == n - 1 && op != RE_MATCH && !is_jump(op))) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Pike VM
+ */
+
+struct re_list {
+    int n;
+    int32_t *pc;
+    int32_t *caps;      /* ncap per thread */
+};
+
+struct re_vm {
+    const uint8_t *code;
+    const uint8_t *classes;
+    const uint8_t *s;
+    size_t len;
+    int ncap;
+    uint32_t gen;
+    uint32_t *mark;
+    int32_t *stack;
+};
+
+size_t hako_re_work_size(const uint8_t *prog)
+{
+    size_t n = prog_ninst(prog);
+    size_t ncap = 2 * (prog[3] + 1);
+
+    /* marks, two thread lists, and the addthread stack */
+    return 4 * (n + 2 * (n + n * ncap) + 2 * (2 * n + 2));
+}
+
+static int assert_holds(const struct re_vm *vm, int kind, size_t sp)
+{
+    const uint8_t *s = vm->s;
+    size_t len = vm->len;
+
+    switch (kind) {
+    case RE_AT_BOL:
+        /* like Onigmo, not after a newline that ends the string */
+        return sp == 0 || (sp < len && s[sp - 1] == '\n');
+    case RE_AT_EOL:
+        return sp == len || s[sp] == '\n';
+    case RE_AT_BOT:
+        return sp == 0;
+    case RE_AT_EOT:
+        return sp == len;
+    case RE_AT_EOTNL:
+        return sp == len || (sp + 1 == len && s[sp] == '\n');
+    default: {
+        int before = sp > 0 && is_word(s[sp - 1]);
+        int after = sp < len && is_word(s[sp]);
+        return (before != after) == (kind == RE_AT_WORDB);
+    }
+    }
+}
+
+/*
+ * Add the thread at pc, following jumps, splits, saves and assertions
+ * at position sp. Higher priority paths are explored first, and each pc
+ * is added once per step, which keeps the list within ninst threads.
+ */
+static void add_thread(struct re_vm *vm, struct re_list *l, int pc0, int32_t *caps, size_t sp)
+{
+    int32_t *stack = vm->stack;
+    int top = 0;
+
+    stack[top++] = pc0;
+    stack[top++] = -1;
+    while (top > 0) {
+        int32_t restore = stack[--top];
+        int32_t pc = stack[--top];
+
+        if (restore >= 0) {
+            /* undo a SAVE once the paths after it are done */
+            caps[restore] = pc;
+            continue;
+        }
+        if (vm->mark[pc] == vm->gen) {
+            continue;
+        }
+        vm->mark[pc] = vm->gen;
+
+        switch (OP(vm->code, pc)) {
+        case RE_JMP:
+            stack[top++] = X(vm->code, pc);
+            stack[top++] = -1;
+            break;
+        case RE_SPLIT:
+            stack[top++] = X(vm->code, pc);
+            stack[top++] = -1;
+            stack[top++] = pc + 1;
+            stack[top++] = -1;
+            break;
+        case RE_RSPLIT:
+            stack[top++] = pc + 1;
+            stack[top++] = -1;
+            stack[top++] = X(vm->code, pc);
+            stack[top++] = -1;
+            break;
+        case RE_SAVE: {
+            int slot = ARG(vm->code, pc);
+            stack[top++] = caps[slot];
+            stack[top++] = slot;
+            caps[slot] = (int32_t)sp;
+            stack[top++] = pc + 1;
+            stack[top++] = -1;
+            break;
+        }
+        case RE_ASSERT:
+            if (assert_holds(vm, ARG(vm->code, pc), sp)) {
+                stack[top++] = pc + 1;
+                stack[top++] = -1;
+            }
+            break;
+        case RE_CONTS:
+            /* a thread that takes more continuation bytes, then skip them */
+            l->pc[l->n] = pc;
+            memcpy(&l->caps[l->n * vm->ncap], caps, sizeof(int32_t) * vm->ncap);
+            l->n++;
+            stack[top++] = pc + 1;
+            stack[top++] = -1;
+            break;
+        default:
+            l->pc[l->n] = pc;
+            memcpy(&l->caps[l->n * vm->ncap], caps, sizeof(int32_t) * vm->ncap);
+            l->n++;
+            break;
+        }
+    }
+}
+
+int hako_re_exec(const uint8_t *prog, const uint8_t *s, size_t len, size_t start,
+                 int32_t *caps, void *work)
+{
+    int n = prog_ninst(prog);
+    struct re_vm vm;
+    struct re_list lists[2];
+    int32_t *w = work;
+
+    vm.code = prog + RE_HEADER;
+    vm.classes = vm.code + 4 * n;
+    vm.s = s;
+    vm.len = len;
+    vm.ncap = 2 * (prog[3] + 1);
+    vm.gen = 1;
+    vm.mark = (uint32_t *)w;
+    w += n;
+    for (int i = 0; i < 2; i++) {
+        lists[i].n = 0;
+        lists[i].pc = w;
+        w += n;
+        lists[i].caps = w;
+        w += n * vm.ncap;
+    }
+    vm.stack = w;
+    memset(vm.mark, 0, sizeof(uint32_t) * n);
+
+    struct re_list *clist = &lists[0];
+    struct re_list *nlist = &lists[1];
+    int matched = 0;
+
+    /* a pattern that starts with a literal byte can skip ahead with memchr */
+    int first = (OP(vm.code, 1) == RE_CHAR) ? ARG(vm.code, 1) : -1;
+
+    if (start > len) {
+        return 0;
+    }
+
+    for (size_t sp = start; sp <= len; sp++) {
+        if (!matched) {
+            if (clist->n == 0 && first >= 0) {
+                const uint8_t *hit = memchr(s + sp, first, len - sp);
+                if (!hit) {
+                    break;
+                }
+                sp = hit - s;
+            }
+            for (int i = 0; i < vm.ncap; i++) {
+                caps[i] = -1;
+            }
+            add_thread(&vm, clist, 0, caps, sp);
+        }
+        if (clist->n == 0) {
+            if (matched) {
+                break;
+            }
+            vm.gen++;
+            continue;
+        }
+
+        vm.gen++;
+        nlist->n = 0;
+        int ch = (sp < len) ? s[sp] : -1;
+
+        for (int i = 0; i < clist->n; i++) {
+            int pc = clist->pc[i];
+            int32_t *tcaps = &clist->caps[i * vm.ncap];
+            int ok;
+
+            switch (OP(vm.code, pc)) {
+            case RE_MATCH:
+                matched = 1;
+                memcpy(caps, tcaps, sizeof(int32_t) * vm.ncap);
+                /* lower priority threads can no longer win */
+                i = clist->n;
+                continue;
+            case RE_CHAR:
+                ok = (ch == ARG(vm.code, pc));
+                break;
+            case RE_CHARI:
+                ok = (ch >= 0 && to_lower(ch) == ARG(vm.code, pc));
+                break;
+            case RE_ANY:
+                ok = (ch >= 0 && ch != '\n');
+                break;
+            case RE_ANYNL:
+                ok = (ch >= 0);
+                break;
+            case RE_CLASS: {
+                const uint8_t *bits = vm.classes + 32 * ARG(vm.code, pc);
+                ok = (ch >= 0 && (bits[ch >> 3] & (1 << (ch & 7))));
+                break;
+            }
+            case RE_CONTS:
+                if (ch >= 0 && (ch & 0xc0) == 0x80) {
+                    add_thread(&vm, nlist, pc, tcaps, sp + 1);
+                }
+                continue;
+            default:
+                continue;
+            }
+            if (ok) {
+                add_thread(&vm, nlist, pc + 1, tcaps, sp + 1);
+            }
+        }
+
+        struct re_list *t = clist;
+        clist = nlist;
+        nlist = t;
+    }
+
+    return matched;
+}
@@ -0,0 +1,980 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file regexp.c
+ * @brief Regexp, MatchData and the String methods that take a pattern
+ *
+ * A Regexp holds its source and its compiled program as Strings. Regexp
+ * literals compiled on the device arrive already compiled and are loaded
+ * with Regexp.__load; everything else goes through Regexp.compile.
+ */
+
+#include <hako/extension.h>
+#include <hako/method.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <string.h>
+
+#include "hako_re.h"
+#include "regexp_ext.h"
+
+LOG_MODULE_REGISTER(hako_regexp, CONFIG_HAKO_LOG_LEVEL);
+
+#define RE_MAX_CAPS (2 * (HAKO_RE_MAX_GROUPS + 1))
+
+/* Numbered globals kept up to date after a match: $1 .. $9 */
+#define RE_NTH_GLOBALS 9
+
+struct regexp {
+    mrbc_value source;
+    mrbc_value prog;
+};
+
+struct match_data {
+    mrbc_value str;
+    int n;              /* groups, including the whole match */
+    int32_t caps[RE_MAX_CAPS];
+};
+
+/* A Regexp, or a String matched literally by sub, gsub and scan */
+struct pattern {
+    const uint8_t *prog;
+    void *work;
+    const uint8_t *lit;
+    int lit_len;
+};
+
+static mrbc_class *regexp_class;
+static mrbc_class *match_data_class;
+static mrbc_class *regexp_error_class;
+static mrbc_func_t string_split;
+static mrbc_func_t string_sub_orig;
+static mrbc_func_t string_gsub_orig;
+
+static mrbc_sym sym_last_match;
+static mrbc_sym sym_nth[RE_NTH_GLOBALS];
+static int nth_set;
+
+static void regexp_free(mrbc_value *self)
+{
+    struct regexp *re = (struct regexp *)self->instance->data;
+
+    mrbc_decref(&re->source);
+    mrbc_decref(&re->prog);
+}
+
+static void match_data_free(mrbc_value *self)
+{
+    struct match_data *md = (struct match_data *)self->instance->data;
+
+    mrbc_decref(&md->str);
+}
+
+static struct regexp *get_regexp(mrbc_value *v)
+{
+    if (v->tt == MRBC_TT_OBJECT && v->instance->cls == regexp_class) {
+        return (struct regexp *)v->instance->data;
+    }
+    return NULL;
+}
+
+static int parse_options(mrbc_value *opt)
+{
+    int flags = 0;
+
+    switch (opt->tt) {
+    case MRBC_TT_INTEGER:
+        return mrbc_integer(*opt) & (HAKO_RE_IGNORECASE | HAKO_RE_EXTENDED | HAKO_RE_MULTILINE);
+    case MRBC_TT_STRING:
+        for (int i = 0; i < opt->string->size; i++) {
+            switch (opt->string->data[i]) {
+            case 'i': flags |= HAKO_RE_IGNORECASE; break;
+            case 'x': flags |= HAKO_RE_EXTENDED; break;
+            case 'm': flags |= HAKO_RE_MULTILINE; break;
+            }
+        }
+        return flags;
+    case MRBC_TT_NIL:
+    case MRBC_TT_FALSE:
+        return 0;
+    default:
+        return HAKO_RE_IGNORECASE;
+    }
+}
+
+static mrbc_value regexp_nomem(mrbc_vm *vm)
+{
+    mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+    return mrbc_nil_value();
+}
+
+/*
+ * Wrap a source and program into a new Regexp; takes both references.
+ * Raises NoMemoryError and returns nil on error.
+ */
+static mrbc_value regexp_wrap(mrbc_vm *vm, mrbc_value source, mrbc_value prog)
+{
+    mrbc_value obj = mrbc_instance_new(vm, regexp_class, sizeof(struct regexp));
+    if (!obj.instance) {
+        mrbc_decref(&source);
+        mrbc_decref(&prog);
+        return regexp_nomem(vm);
+    }
+    struct regexp *re = (struct regexp *)obj.instance->data;
+
+    re->source = source;
+    re->prog = prog;
+    return obj;
+}
+
+/* Compile src into a new Regexp; raises RegexpError and returns nil on error */
+static mrbc_value regexp_compile(mrbc_vm *vm, const char *src, int len, int flags)
+{
+    uint8_t *buf = mrbc_alloc(vm, CONFIG_HAKO_REGEXP_PROGRAM_SIZE);
+    if (!buf) {
+        return regexp_nomem(vm);
+    }
+
+    const char *err;
+    int plen = hako_re_compile(src, len, flags, buf, CONFIG_HAKO_REGEXP_PROGRAM_SIZE, &err);
+    if (plen < 0) {
+        mrbc_free(vm, buf);
+        mrbc_raisef(vm, regexp_error_class, "%s: /%s/", err,
+                    len < 64 ? src : "...");
+        return mrbc_nil_value();
+    }
+
+    mrbc_value prog = mrbc_string_new(vm, buf, plen);
+    mrbc_free(vm, buf);
+    if (prog.tt != MRBC_TT_STRING || !prog.string) {
+        return regexp_nomem(vm);
+    }
+    mrbc_value source = mrbc_string_new(vm, src, len);
+    if (source.tt != MRBC_TT_STRING || !source.string) {
+        mrbc_decref(&prog);
+        return regexp_nomem(vm);
+    }
+    return regexp_wrap(vm, source, prog);
+}
+
+/* Prepare p for matching; returns -1 (having raised) on error */
+static int pattern_init(mrbc_vm *vm, struct pattern *p, mrbc_value *v, int literal_ok)
+{
+    struct regexp *re = get_regexp(v);
+
+    memset(p, 0, sizeof(*p));
+    if (re) {
+        p->prog = re->prog.string->data;
+        p->work = mrbc_alloc(vm, hako_re_work_size(p->prog));
+        if (!p->work) {
+            mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+            return -1;
+        }
+        return 0;
+    }
+    if (literal_ok && v->tt == MRBC_TT_STRING) {
+        p->lit = v->string->data;
+        p->lit_len = v->string->size;
+        return 0;
+    }
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong argument type (expected Regexp)");
+    return -1;
+}
+
+static void pattern_done(mrbc_vm *vm, struct pattern *p)
+{
+    if (p->work) {
+        mrbc_free(vm, p->work);
+    }
+}
+
+static int pattern_groups(const struct pattern *p)
+{
+    return p->prog ? hako_re_groups(p->prog) : 0;
+}
+
+/* Search str from start; fills caps and returns 1 on a match */
+static int pattern_search(const struct pattern *p, const mrbc_value *str, int start, int32_t *caps)
+{
+    const uint8_t *s = str->string->data;
+    int len = str->string->size;
+
+    if (p->prog) {
+        return hako_re_exec(p->prog, s, len, start, caps, p->work);
+    }
+
+    for (int i = start; i + p->lit_len <= len; i++) {
+        const uint8_t *hit = (p->lit_len == 0) ? s + i : memchr(s + i, p->lit[0], len - i);
+        if (!hit || hit + p->lit_len > s + len) {
+            break;
+        }
+        i = hit - s;
+        if (memcmp(hit, p->lit, p->lit_len) == 0) {
+            caps[0] = i;
+            caps[1] = i + p->lit_len;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Raises NoMemoryError and returns nil on error */
+static mrbc_value match_data_new(mrbc_vm *vm, mrbc_value *str, int groups, const int32_t *caps)
+{
+    mrbc_value obj = mrbc_instance_new(vm, match_data_class, sizeof(struct match_data));
+    if (!obj.instance) {
+        return regexp_nomem(vm);
+    }
+    struct match_data *md = (struct match_data *)obj.instance->data;
+
+    md->str = *str;
+    mrbc_incref(&md->str);
+    md->n = groups + 1;
+    memcpy(md->caps, caps, sizeof(int32_t) * 2 * md->n);
+    return obj;
+}
+
+static mrbc_value substr(mrbc_vm *vm, const mrbc_value *str, int32_t beg, int32_t end)
+{
+    if (beg < 0) {
+        return mrbc_nil_value();
+    }
+    /* the string may have been shortened since the match */
+    if (end > str->string->size) {
+        end = str->string->size;
+    }
+    if (beg > end) {
+        beg = end;
+    }
+    return mrbc_string_new(vm, str->string->data + beg, end - beg);
+}
+
+/*
+ * Set $~ and $1 .. $9 after a match attempt; md is nil if there was no
+ * match. Takes the reference to md.
+ */
+static void set_last_match(mrbc_vm *vm, mrbc_value *md)
+{
+    int n = 0;
+
+    if (md->tt != MRBC_TT_NIL) {
+        struct match_data *m = (struct match_data *)md->instance->data;
+        n = m->n - 1;
+        if (n > RE_NTH_GLOBALS) {
+            n = RE_NTH_GLOBALS;
+        }
+        for (int i = 0; i < n; i++) {
+            mrbc_value s = substr(vm, &m->str, m->caps[2 * i + 2], m->caps[2 * i + 3]);
+            mrbc_set_global(sym_nth[i], &s);
+        }
+    }
+    /* clear the numbered globals a previous match left behind */
+    for (int i = n; i < nth_set; i++) {
+        mrbc_value nil = mrbc_nil_value();
+        mrbc_set_global(sym_nth[i], &nil);
+    }
+    nth_set = n;
+    mrbc_set_global(sym_last_match, md);
+}
+
+/* Match and set the globals; returns the MatchData (nil if none) in *out */
+static int do_match(mrbc_vm *vm, mrbc_value *re_v, mrbc_value *str, int pos, mrbc_value *out)
+{
+    struct pattern p;
+    int32_t caps[RE_MAX_CAPS];
+
+    *out = mrbc_nil_value();
+    if (str->tt == MRBC_TT_NIL) {
+        set_last_match(vm, out);
+        return 0;
+    }
+    if (str->tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return -1;
+    }
+    if (pos < 0) {
+        pos += str->string->size;
+    }
+    if (pos < 0 || pos > str->string->size) {
+        set_last_match(vm, out);
+        return 0;
+    }
+    if (pattern_init(vm, &p, re_v, 0) < 0) {
+        return -1;
+    }
+
+    int matched = pattern_search(&p, str, pos, caps);
+    if (matched) {
+        *out = match_data_new(vm, str, pattern_groups(&p), caps);
+        if (out->tt == MRBC_TT_NIL) {
+            pattern_done(vm, &p);
+            return -1;
+        }
+        mrbc_incref(out);
+    }
+    pattern_done(vm, &p);
+    set_last_match(vm, out);
+    return matched;
+}
+
+/*
+ * Regexp
+ */
+
+static void c_regexp_compile(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+
+    struct regexp *re = get_regexp(&v[1]);
+    if (re) {
+        mrbc_incref(&re->source);
+        mrbc_incref(&re->prog);
+        mrbc_value obj = regexp_wrap(vm, re->source, re->prog);
+        SET_RETURN(obj);
+        return;
+    }
+    if (v[1].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    /* a third argument (encoding) is accepted and ignored */
+    int flags = (argc >= 2) ? parse_options(&v[2]) : 0;
+    mrbc_value obj = regexp_compile(vm, (const char *)v[1].string->data,
+                                    v[1].string->size, flags);
+    SET_RETURN(obj);
+}
+
+/* Regexp.__load(prog, source): a literal compiled by the on-device compiler */
+static void c_regexp_load(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc != 2 || v[1].tt != MRBC_TT_STRING || v[2].tt != MRBC_TT_STRING ||
+        hako_re_check(v[1].string->data, v[1].string->size) < 0) {
+        mrbc_raise(vm, regexp_error_class, "invalid compiled regexp");
+        return;
+    }
+
+    mrbc_incref(&v[1]);
+    mrbc_incref(&v[2]);
+    mrbc_value obj = regexp_wrap(vm, v[2], v[1]);
+    SET_RETURN(obj);
+}
+
+static void c_regexp_match(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value md;
+    int pos = (argc >= 2 && v[2].tt == MRBC_TT_INTEGER) ? mrbc_integer(v[2]) : 0;
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+    if (do_match(vm, &v[0], &v[1], pos, &md) < 0) {
+        return;
+    }
+    SET_RETURN(md);
+}
+
+static void c_regexp_match_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct pattern p;
+    int32_t caps[RE_MAX_CAPS];
+    int pos = (argc >= 2 && v[2].tt == MRBC_TT_INTEGER) ? mrbc_integer(v[2]) : 0;
+
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        SET_FALSE_RETURN();
+        return;
+    }
+    if (pos < 0) {
+        pos += v[1].string->size;
+    }
+    if (pos < 0 || pos > v[1].string->size) {
+        SET_FALSE_RETURN();
+        return;
+    }
+    if (pattern_init(vm, &p, &v[0], 0) < 0) {
+        return;
+    }
+    /* match? leaves $~ alone */
+    int matched = pattern_search(&p, &v[1], pos, caps);
+    pattern_done(vm, &p);
+    SET_BOOL_RETURN(matched);
+}
+
+static void c_regexp_match_op(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value md;
+
+    if (argc < 1 || do_match(vm, &v[0], &v[1], 0, &md) <= 0) {
+        SET_NIL_RETURN();
+        return;
+    }
+
+    int32_t beg = ((struct match_data *)md.instance->data)->caps[0];
+    mrbc_decref(&md);
+    SET_INT_RETURN(beg);
+}
+
+static void c_regexp_eqq(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value md;
+
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING) {
+        SET_FALSE_RETURN();
+        return;
+    }
+
+    int matched = do_match(vm, &v[0], &v[1], 0, &md);
+    if (matched > 0) {
+        mrbc_decref(&md);
+    }
+    SET_BOOL_RETURN(matched > 0);
+}
+
+static void c_regexp_source(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct regexp *re = (struct regexp *)v[0].instance->data;
+
+    mrbc_incref(&re->source);
+    SET_RETURN(re->source);
+}
+
+static void c_regexp_options(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct regexp *re = (struct regexp *)v[0].instance->data;
+
+    SET_INT_RETURN(hako_re_flags(re->prog.string->data));
+}
+
+/*
+ * MatchData
+ */
+
+static int match_index(mrbc_vm *vm, struct match_data *md, mrbc_value *idx)
+{
+    if (idx->tt != MRBC_TT_INTEGER) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into Integer");
+        return -1;
+    }
+
+    int i = mrbc_integer(*idx);
+    if (i < 0) {
+        i += md->n;
+    }
+    return (i >= 0 && i < md->n) ? i : -2;
+}
+
+static void c_match_data_aref(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+    int i = (argc >= 1) ? match_index(vm, md, &v[1]) : -1;
+
+    if (i == -1) {
+        return;
+    }
+    if (i < 0) {
+        SET_NIL_RETURN();
+        return;
+    }
+    mrbc_value s = substr(vm, &md->str, md->caps[2 * i], md->caps[2 * i + 1]);
+    SET_RETURN(s);
+}
+
+static void match_data_to_a(mrbc_vm *vm, mrbc_value *v, int first)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+    mrbc_value ary = mrbc_array_new(vm, md->n - first);
+
+    for (int i = first; i < md->n; i++) {
+        mrbc_value s = substr(vm, &md->str, md->caps[2 * i], md->caps[2 * i + 1]);
+        mrbc_array_push(&ary, &s);
+    }
+    SET_RETURN(ary);
+}
+
+static void c_match_data_to_a(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    match_data_to_a(vm, v, 0);
+}
+
+static void c_match_data_captures(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    match_data_to_a(vm, v, 1);
+}
+
+static void c_match_data_to_s(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+    mrbc_value s = substr(vm, &md->str, md->caps[0], md->caps[1]);
+
+    SET_RETURN(s);
+}
+
+static void c_match_data_pre_match(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+    mrbc_value s = substr(vm, &md->str, 0, md->caps[0]);
+
+    SET_RETURN(s);
+}
+
+static void c_match_data_post_match(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+    mrbc_value s = substr(vm, &md->str, md->caps[1], md->str.string->size);
+
+    SET_RETURN(s);
+}
+
+static void match_data_offset(mrbc_vm *vm, mrbc_value *v, int argc, int end)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+    int i = (argc >= 1) ? match_index(vm, md, &v[1]) : 0;
+
+    if (i == -1) {
+        return;
+    }
+    if (i < 0) {
+        mrbc_raise(vm, MRBC_CLASS(IndexError), "index out of matches");
+        return;
+    }
+    if (md->caps[2 * i] < 0) {
+        SET_NIL_RETURN();
+        return;
+    }
+    SET_INT_RETURN(md->caps[2 * i + end]);
+}
+
+static void c_match_data_begin(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    match_data_offset(vm, v, argc, 0);
+}
+
+static void c_match_data_end(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    match_data_offset(vm, v, argc, 1);
+}
+
+static void c_match_data_size(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct match_data *md = (struct match_data *)v[0].instance->data;
+
+    SET_INT_RETURN(md->n);
+}
+
+/*
+ * String
+ */
+
+static void c_string_match_op(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value md;
+
+    if (argc < 1 || !get_regexp(&v[1])) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong argument type (expected Regexp)");
+        return;
+    }
+    if (do_match(vm, &v[1], &v[0], 0, &md) <= 0) {
+        SET_NIL_RETURN();
+        return;
+    }
+
+    int32_t beg = ((struct match_data *)md.instance->data)->caps[0];
+    mrbc_decref(&md);
+    SET_INT_RETURN(beg);
+}
+
+/* String#match and match? with a String argument compile it first */
+static int string_pattern(mrbc_vm *vm, mrbc_value *arg, mrbc_value *re)
+{
+    if (get_regexp(arg)) {
+        *re = *arg;
+        mrbc_incref(re);
+        return 0;
+    }
+    if (arg->tt == MRBC_TT_STRING) {
+        *re = regexp_compile(vm, (const char *)arg->string->data, arg->string->size, 0);
+        return (re->tt == MRBC_TT_NIL) ? -1 : 0;
+    }
+    mrbc_raise(vm, MRBC_CLASS(TypeError), "wrong argument type (expected Regexp)");
+    return -1;
+}
+
+static void c_string_match(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value re;
+    mrbc_value md;
+    int pos = (argc >= 2 && v[2].tt == MRBC_TT_INTEGER) ? mrbc_integer(v[2]) : 0;
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+    if (string_pattern(vm, &v[1], &re) < 0) {
+        return;
+    }
+
+    int ret = do_match(vm, &re, &v[0], pos, &md);
+    mrbc_decref(&re);
+    if (ret >= 0) {
+        SET_RETURN(md);
+    }
+}
+
+static void c_string_match_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    mrbc_value re;
+    struct pattern p;
+    int32_t caps[RE_MAX_CAPS];
+
+    if (argc < 1) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        return;
+    }
+    if (string_pattern(vm, &v[1], &re) < 0) {
+        return;
+    }
+    if (pattern_init(vm, &p, &re, 0) < 0) {
+        mrbc_decref(&re);
+        return;
+    }
+
+    int matched = pattern_search(&p, &v[0], 0, caps);
+    pattern_done(vm, &p);
+    mrbc_decref(&re);
+    SET_BOOL_RETURN(matched);
+}
+
+/* Bytes in the UTF-8 character at s[i], at least 1 */
+static int char_len(const mrbc_value *str, int i)
+{
+    const uint8_t *s = str->string->data;
+    int len = str->string->size;
+    int n = 1;
+
+    while (i + n < len && (s[i + n] & 0xc0) == 0x80) {
+        n++;
+    }
+    return n;
+}
+
+static void c_string_scan(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    struct pattern p;
+    int32_t caps[RE_MAX_CAPS];
+    int32_t last[RE_MAX_CAPS];
+    int found = 0;
+
+    if (argc < 1 || pattern_init(vm, &p, &v[1], 1) < 0) {
+        if (argc < 1) {
+            mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments");
+        }
+        return;
+    }
+
+    int groups = pattern_groups(&p);
+    int len = v[0].string->size;
+    mrbc_value ary = mrbc_array_new(vm, 0);
+
+    for (int pos = 0; pos <= len && pattern_search(&p, &v[0], pos, caps); ) {
+        mrbc_value item;
+        if (groups == 0) {
+            item = substr(vm, &v[0], caps[0], caps[1]);
+        } else {
+            item = mrbc_array_new(vm, groups);
+            for (int i = 1; i <= groups; i++) {
+                mrbc_value s = substr(vm, &v[0], caps[2 * i], caps[2 * i + 1]);
+                mrbc_array_push(&item, &s);
+            }
+        }
+        mrbc_array_push(&ary, &item);
+        memcpy(last, caps, sizeof(int32_t) * 2 * (groups + 1));
+        found = 1;
+
+        /* an empty match moves on by one character */
+        pos = (caps[1] > caps[0]) ? caps[1] : caps[1] + char_len(&v[0], caps[1]);
+    }
+    pattern_done(vm, &p);
+
+    if (p.prog) {
+        mrbc_value md = found ? match_data_new(vm, &v[0], groups, last) : mrbc_nil_value();
+        set_last_match(vm, &md);
+    }
+    SET_RETURN(ary);
+}
+
+/* Append repl to out, expanding \0 \& \1-\9 \` \' and \\ */
+static void append_replacement(mrbc_value *out, const mrbc_value *repl,
+                               const mrbc_value *str, const int32_t *caps, int groups)
+{
+    const uint8_t *r = repl->string->data;
+    int rlen = repl->string->size;
+    const uint8_t *s = str->string->data;
+    int run = 0;
+
+    for (int i = 0; i < rlen; i++) {
+        if (r[i] != '\\' || i + 1 == rlen) {
+            continue;
+        }
+
+        int beg = -1;
+        int end = -1;
+        int c = r[i + 1];
+        if (c >= '0' && c <= '9') {
+            if (c - '0' <= groups) {
+                beg = caps[2 * (c - '0')];
+                end = caps[2 * (c - '0') + 1];
+            }
+        } else if (c == '&') {
+            beg = caps[0];
+            end = caps[1];
+        } else if (c == '`') {
+            beg = 0;
+            end = caps[0];
+        } else if (c == '\'') {
+            beg = caps[1];
+            end = str->string->size;
+        } else if (c != '\\') {
+            continue;
+        }
+
+        mrbc_string_append_cbuf(out, r + run, i - run);
+        if (c == '\\') {
+            mrbc_string_append_cbuf(out, "\\", 1);
+        } else if (beg >= 0) {
+            mrbc_string_append_cbuf(out, s + beg, end - beg);
+        }
+        i++;
+        run = i + 1;
+    }
+    mrbc_string_append_cbuf(out, r + run, rlen - run);
+}
+
+static void string_sub(mrbc_vm *vm, mrbc_value *v, int argc, int global)
+{
+    struct pattern p;
+    int32_t caps[RE_MAX_CAPS];
+    int32_t last[RE_MAX_CAPS];
+    int found = 0;
+
+    if (argc < 2) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "wrong number of arguments (blocks are not supported)");
+        return;
+    }
+    if (v[2].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+    if (pattern_init(vm, &p, &v[1], 1) < 0) {
+        return;
+    }
+
+    int groups = pattern_groups(&p);
+    const uint8_t *s = v[0].string->data;
+    int len = v[0].string->size;
+    int copied = 0;
+    mrbc_value out = mrbc_string_new(vm, NULL, 0);
+
+    for (int pos = 0; pos <= len && pattern_search(&p, &v[0], pos, caps); ) {
+        mrbc_string_append_cbuf(&out, s + copied, caps[0] - copied);
+        append_replacement(&out, &v[2], &v[0], caps, groups);
+        copied = caps[1];
+        memcpy(last, caps, sizeof(int32_t) * 2 * (groups + 1));
+        found = 1;
+        if (!global) {
+            break;
+        }
+
+        pos = caps[1];
+        if (caps[1] == caps[0]) {
+            /* an empty match: keep the next character and move past it */
+            if (pos >= len) {
+                break;
+            }
+            int n = char_len(&v[0], pos);
+            mrbc_string_append_cbuf(&out, s + pos, n);
+            copied = pos += n;
+        }
+    }
+    mrbc_string_append_cbuf(&out, s + copied, len - copied);
+    pattern_done(vm, &p);
+
+    if (p.prog) {
+        mrbc_value md = found ? match_data_new(vm, &v[0], groups, last) : mrbc_nil_value();
+        set_last_match(vm, &md);
+    }
+    SET_RETURN(out);
+}
+
+/* String#sub and gsub with a Regexp; a String pattern goes to the replaced method if any */
+static void c_string_sub(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc >= 1 && !get_regexp(&v[1]) && string_sub_orig) {
+        string_sub_orig(vm, v, argc);
+        return;
+    }
+    string_sub(vm, v, argc, 0);
+}
+
+static void c_string_gsub(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc >= 1 && !get_regexp(&v[1]) && string_gsub_orig) {
+        string_gsub_orig(vm, v, argc);
+        return;
+    }
+    string_sub(vm, v, argc, 1);
+}
+
+/* String#split with a Regexp; anything else goes to the VM's split */
+static void c_string_split(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || !get_regexp(&v[1])) {
+        string_split(vm, v, argc);
+        return;
+    }
+
+    struct pattern p;
+    int32_t caps[RE_MAX_CAPS];
+    int limit = (argc >= 2 && v[2].tt == MRBC_TT_INTEGER) ? mrbc_integer(v[2]) : 0;
+
+    if (pattern_init(vm, &p, &v[1], 0) < 0) {
+        return;
+    }
+
+    int groups = pattern_groups(&p);
+    int len = v[0].string->size;
+    int beg = 0;
+    int start = 0;
+    int last_null = 0;
+    int count = 0;
+    mrbc_value ary = mrbc_array_new(vm, 0);
+
+    /* follows CRuby's rb_str_split_m for a regexp separator */
+    while ((limit <= 0 || count + 1 < limit) && start <= len &&
+           pattern_search(&p, &v[0], start, caps)) {
+        mrbc_value field;
+        if (start == caps[0] && caps[0] == caps[1]) {
+            if (len == 0) {
+                field = mrbc_string_new(vm, NULL, 0);
+                mrbc_array_push(&ary, &field);
+                break;
+            } else if (last_null) {
+                field = substr(vm, &v[0], beg, start);
+                mrbc_array_push(&ary, &field);
+                beg = start;
+            } else {
+                start += (start == len) ? 1 : char_len(&v[0], start);
+                last_null = 1;
+                continue;
+            }
+        } else {
+            field = substr(vm, &v[0], beg, caps[0]);
+            mrbc_array_push(&ary, &field);
+            beg = start = caps[1];
+        }
+        last_null = 0;
+
+        for (int i = 1; i <= groups; i++) {
+            if (caps[2 * i] >= 0) {
+                field = substr(vm, &v[0], caps[2 * i], caps[2 * i + 1]);
+                mrbc_array_push(&ary, &field);
+            }
+        }
+        count++;
+    }
+    pattern_done(vm, &p);
+
+    if (len > 0 && (limit != 0 || len > beg)) {
+        mrbc_value field = substr(vm, &v[0], beg, len);
+        mrbc_array_push(&ary, &field);
+    }
+    if (limit == 0) {
+        /* drop trailing empty fields */
+        while (ary.array->n_stored > 0) {
+            mrbc_value *tail = &ary.array->data[ary.array->n_stored - 1];
+            if (tail->string->size > 0) {
+                break;
+            }
+            mrbc_decref(tail);
+            ary.array->n_stored--;
+        }
+    }
+    SET_RETURN(ary);
+}
+
+/**
+ * Initialize the regexp extension
+ */
+void mrbc_regexp_init(void)
+{
+    regexp_class = mrbc_define_class(0, "Regexp", mrbc_class_object);
+    match_data_class = mrbc_define_class(0, "MatchData", mrbc_class_object);
+    regexp_error_class = mrbc_define_class(0, "RegexpError", MRBC_CLASS(StandardError));
+    mrbc_define_destructor(regexp_class, regexp_free);
+    mrbc_define_destructor(match_data_class, match_data_free);
+
+    static const struct {
+        const char *name;
+        int value;
+    } options[] = {
+        { "IGNORECASE", HAKO_RE_IGNORECASE },
+        { "EXTENDED", HAKO_RE_EXTENDED },
+        { "MULTILINE", HAKO_RE_MULTILINE },
+    };
+    for (size_t i = 0; i < ARRAY_SIZE(options); i++) {
+        mrbc_value value = mrbc_integer_value(options[i].value);
+        mrbc_set_class_const(regexp_class, mrbc_str_to_symid(options[i].name), &value);
+    }
+
+    mrbc_define_method(0, regexp_class, "new", c_regexp_compile);
+    mrbc_define_method(0, regexp_class, "compile", c_regexp_compile);
+    mrbc_define_method(0, regexp_class, "__load", c_regexp_load);
+    mrbc_define_method(0, regexp_class, "match", c_regexp_match);
+    mrbc_define_method(0, regexp_class, "match?", c_regexp_match_p);
+    mrbc_define_method(0, regexp_class, "=~", c_regexp_match_op);
+    mrbc_define_method(0, regexp_class, "===", c_regexp_eqq);
+    mrbc_define_method(0, regexp_class, "source", c_regexp_source);
+    mrbc_define_method(0, regexp_class, "to_s", c_regexp_source);
+    mrbc_define_method(0, regexp_class, "options", c_regexp_options);
+
+    mrbc_define_method(0, match_data_class, "[]", c_match_data_aref);
+    mrbc_define_method(0, match_data_class, "to_a", c_match_data_to_a);
+    mrbc_define_method(0, match_data_class, "captures", c_match_data_captures);
+    mrbc_define_method(0, match_data_class, "to_s", c_match_data_to_s);
+    mrbc_define_method(0, match_data_class, "pre_match", c_match_data_pre_match);
+    mrbc_define_method(0, match_data_class, "post_match", c_match_data_post_match);
+    mrbc_define_method(0, match_data_class, "begin", c_match_data_begin);
+    mrbc_define_method(0, match_data_class, "end", c_match_data_end);
+    mrbc_define_method(0, match_data_class, "size", c_match_data_size);
+    mrbc_define_method(0, match_data_class, "length", c_match_data_size);
+
+    mrbc_define_method(0, MRBC_CLASS(String), "=~", c_string_match_op);
+    mrbc_define_method(0, MRBC_CLASS(String), "match", c_string_match);
+    mrbc_define_method(0, MRBC_CLASS(String), "match?", c_string_match_p);
+    mrbc_define_method(0, MRBC_CLASS(String), "scan", c_string_scan);
+    string_sub_orig = hako_find_c_method(MRBC_CLASS(String), "sub");
+    string_gsub_orig = hako_find_c_method(MRBC_CLASS(String), "gsub");
+    mrbc_define_method(0, MRBC_CLASS(String), "sub", c_string_sub);
+    mrbc_define_method(0, MRBC_CLASS(String), "gsub", c_string_gsub);
+
+    string_split = hako_find_c_method(MRBC_CLASS(String), "split");
+    if (string_split) {
+        mrbc_define_method(0, MRBC_CLASS(String), "split", c_string_split);
+    }
+
+    sym_last_match = mrbc_str_to_symid("$~");
+    for (int i = 0; i < RE_NTH_GLOBALS; i++) {
+        static const char *const names[RE_NTH_GLOBALS] = {
+            "$1", "$2", "$3", "$4", "$5", "$6", "$7", "$8", "$9",
+        };
+        sym_nth[i] = mrbc_str_to_symid(names[i]);
+    }
+
+    LOG_DBG("Regexp, MatchData registered");
+}
+
+HAKO_EXTENSION_DEFINE(regexp, mrbc_regexp_init, HAKO_EXTENSION_PRIORITY_DEFAULT);
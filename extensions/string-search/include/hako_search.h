@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file hako_search.h
+ * @brief Substring search
+ *
+ * A needle is prepared once and then searched for any number of times.
+ * Single bytes use memchr(); needles of up to three bytes look for
+ * their first byte with memchr() and compare the rest; longer needles
+ * use Horspool's algorithm, which skips ahead by up to the needle
+ * length on each mismatch.
+ */
+
+#ifndef HAKO_SEARCH_H
+#define HAKO_SEARCH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Needles at least this long use the Horspool skip table */
+#define HAKO_SEARCH_HORSPOOL_MIN 4
+
+/**
+ * @brief A prepared needle
+ *
+ * The needle is not copied and must outlive the searcher.
+ */
+struct hako_search {
+    const uint8_t *needle;
+    int len;
+    uint8_t shift[256];     /**< Horspool shifts, capped at 255 */
+};
+
+/**
+ * @brief Prepare a needle
+ *
+ * @param s Searcher to initialize
+ * @param needle Bytes to search for
+ * @param len Length of needle, may be 0
+ */
+void hako_search_init(struct hako_search *s, const uint8_t *needle, int len);
+
+/**
+ * @brief Find the needle in hay at or after start
+ *
+ * @param s Prepared searcher
+ * @param hay Haystack
+ * @param hlen Length of hay
+ * @param start Offset to start from
+ * @return Offset of the first match, or -1. An empty needle matches at
+ *         start if start <= hlen.
+ */
+int hako_search_find(const struct hako_search *s, const uint8_t *hay, int hlen, int start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAKO_SEARCH_H */
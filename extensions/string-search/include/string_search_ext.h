@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file string_search_ext.h
+ * @brief String search extension public API
+ */
+
+#ifndef STRING_SEARCH_EXT_H
+#define STRING_SEARCH_EXT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Initialize the string search extension
+ *
+ * Replaces String#index, include?, start_with?, end_with?, split, sub
+ * and gsub, keeping the previous definitions for arguments that are
+ * not Strings. Called automatically by HAKO loader during
+ * initialization, after the default-priority extensions.
+ */
+void mrbc_string_search_init(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* STRING_SEARCH_EXT_H */
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file search.c
+ * @brief Substring search: memchr() for short needles, Horspool for long
+ */
+
+#include <string.h>
+
+#include "hako_search.h"
+
+void hako_search_init(struct hako_search *s, const uint8_t *needle, int len)
+{
+    s->needle = needle;
+    s->len = len;
+    if (len < HAKO_SEARCH_HORSPOOL_MIN) {
+        return;
+    }
+
+    /* shift by the distance from a byte's last position to the end */
+    memset(s->shift, len > 255 ? 255 : len, sizeof(s->shift));
+    for (int i = (len > 256) ? len - 256 : 0; i < len - 1; i++) {
+        s->shift[needle[i]] = len - 1 - i;
+    }
+}
+
+/* First byte with memchr(), then compare the rest */
+static int find_short(const struct hako_search *s, const uint8_t *hay, int hlen, int start)
+{
+    const uint8_t *p = hay + start;
+    const uint8_t *last = hay + hlen - s->len;
+    int first = s->needle[0];
+
+    while (p <= last) {
+        p = memchr(p, first, last - p + 1);
+        if (!p) {
+            return -1;
+        }
+        if (memcmp(p + 1, s->needle + 1, s->len - 1) == 0) {
+            return p - hay;
+        }
+        p++;
+    }
+    return -1;
+}
+
+static int find_horspool(const struct hako_search *s, const uint8_t *hay, int hlen, int start)
+{
+    int n = s->len - 1;
+    int tail = s->needle[n];
+
+    for (int i = start; i + n < hlen; ) {
+        int c = hay[i + n];
+        if (c == tail && memcmp(hay + i, s->needle, n) == 0) {
+            return i;
+        }
+        i += s->shift[c];
+    }
+    return -1;
+}
+
+int hako_search_find(const struct hako_search *s, const uint8_t *hay, int hlen, int start)
+{
+    if (start < 0 || start > hlen - s->len) {
+        return -1;
+    }
+    if (s->len == 0) {
+        return start;
+    }
+    if (s->len == 1) {
+        const uint8_t *p = memchr(hay + start, s->needle[0], hlen - start);
+        return p ? p - hay : -1;
+    }
+    if (s->len < HAKO_SEARCH_HORSPOOL_MIN) {
+        return find_short(s, hay, hlen, start);
+    }
+    return find_horspool(s, hay, hlen, start);
+}
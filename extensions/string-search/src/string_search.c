@@ -0,0 +1,382 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file string_search.c
+ * @brief String#index, include?, start_with?, end_with?, split, sub and
+ *        gsub with String arguments
+ *
+ * Each method searches with a prepared hako_search needle. split and gsub
+ * count their matches before building the result, so the Array or String
+ * is allocated once at its final size; the first matches are remembered
+ * during the count so the second pass does not search for them again.
+ *
+ * Arguments other than Strings (a Regexp, a block form, awk-style split)
+ * go to the method this one replaced.
+ */
+
+#include <hako/extension.h>
+#include <hako/method.h>
+#include <mrubyc.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include <string.h>
+
+#include "hako_search.h"
+#include "string_search_ext.h"
+
+LOG_MODULE_REGISTER(hako_string_search, CONFIG_HAKO_LOG_LEVEL);
+
+/* Match offsets remembered by the counting pass */
+#define SAVED_HITS 32
+
+static mrbc_func_t orig_index;
+static mrbc_func_t orig_include_p;
+static mrbc_func_t orig_start_with_p;
+static mrbc_func_t orig_end_with_p;
+static mrbc_func_t orig_split;
+static mrbc_func_t orig_sub;
+static mrbc_func_t orig_gsub;
+
+/* Append a copy of p[0, n) to ary; raises and returns -1 when out of memory */
+static int push_field(mrbc_vm *vm, mrbc_value *ary, const uint8_t *p, int n)
+{
+    mrbc_value field = mrbc_string_new(vm, p, n);
+
+    if (field.tt != MRBC_TT_STRING || !field.string) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return -1;
+    }
+    if (mrbc_array_push(ary, &field) != 0) {
+        mrbc_decref(&field);
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return -1;
+    }
+    return 0;
+}
+
+struct hits {
+    int count;
+    int saved[SAVED_HITS];
+};
+
+/* Count up to max matches, remembering the first SAVED_HITS offsets */
+static int count_hits(const struct hako_search *s, const uint8_t *p, int len, int max, struct hits *h)
+{
+    int pos = 0;
+
+    h->count = 0;
+    while (h->count < max) {
+        int at = hako_search_find(s, p, len, pos);
+        if (at < 0) {
+            break;
+        }
+        if (h->count < SAVED_HITS) {
+            h->saved[h->count] = at;
+        }
+        h->count++;
+        pos = at + s->len;
+    }
+    return h->count;
+}
+
+/* The i-th match, searching on from pos once past the remembered ones */
+static int nth_hit(const struct hako_search *s, const uint8_t *p, int len,
+                   const struct hits *h, int i, int pos)
+{
+    return (i < SAVED_HITS) ? h->saved[i] : hako_search_find(s, p, len, pos);
+}
+
+/*
+ * index, include?, start_with?, end_with?
+ */
+
+static void c_string_index(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING ||
+        (argc >= 2 && v[2].tt != MRBC_TT_INTEGER)) {
+        hako_call_original(vm, v, argc, orig_index,
+                           MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    int len = v[0].string->size;
+    int pos = (argc >= 2) ? mrbc_integer(v[2]) : 0;
+    if (pos < 0) {
+        pos += len;
+    }
+
+    struct hako_search s;
+    hako_search_init(&s, v[1].string->data, v[1].string->size);
+
+    int at = hako_search_find(&s, v[0].string->data, len, pos);
+    if (at < 0) {
+        SET_NIL_RETURN();
+    } else {
+        SET_INT_RETURN(at);
+    }
+}
+
+static void c_string_include_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc != 1 || v[1].tt != MRBC_TT_STRING) {
+        hako_call_original(vm, v, argc, orig_include_p,
+                           MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    struct hako_search s;
+    hako_search_init(&s, v[1].string->data, v[1].string->size);
+    SET_BOOL_RETURN(hako_search_find(&s, v[0].string->data, v[0].string->size, 0) >= 0);
+}
+
+/* Does any argument match at the start (or end) of the receiver? */
+static void string_affix_p(mrbc_vm *vm, mrbc_value *v, int argc, int at_end, mrbc_func_t orig)
+{
+    for (int i = 1; i <= argc; i++) {
+        if (v[i].tt != MRBC_TT_STRING) {
+            hako_call_original(vm, v, argc, orig,
+                               MRBC_CLASS(TypeError), "no implicit conversion into String");
+            return;
+        }
+    }
+
+    int len = v[0].string->size;
+    for (int i = 1; i <= argc; i++) {
+        int n = v[i].string->size;
+        if (n <= len &&
+            memcmp(v[0].string->data + (at_end ? len - n : 0), v[i].string->data, n) == 0) {
+            SET_BOOL_RETURN(1);
+            return;
+        }
+    }
+    SET_BOOL_RETURN(0);
+}
+
+static void c_string_start_with_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    string_affix_p(vm, v, argc, 0, orig_start_with_p);
+}
+
+static void c_string_end_with_p(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    string_affix_p(vm, v, argc, 1, orig_end_with_p);
+}
+
+/*
+ * split
+ */
+
+/* String#split with a String separator other than " " and "" */
+static void c_string_split(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc < 1 || v[1].tt != MRBC_TT_STRING || v[1].string->size == 0 ||
+        (v[1].string->size == 1 && v[1].string->data[0] == ' ') ||
+        (argc >= 2 && v[2].tt != MRBC_TT_INTEGER)) {
+        hako_call_original(vm, v, argc, orig_split,
+                           MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    const uint8_t *p = v[0].string->data;
+    int len = v[0].string->size;
+    int limit = (argc >= 2) ? mrbc_integer(v[2]) : 0;
+    struct hako_search s;
+    struct hits h;
+
+    if (len == 0) {
+        SET_RETURN(mrbc_array_new(vm, 0));
+        return;
+    }
+
+    /* follows CRuby's rb_str_split_m for a string separator */
+    hako_search_init(&s, v[1].string->data, v[1].string->size);
+    int n = count_hits(&s, p, len, (limit > 0) ? limit - 1 : len, &h);
+
+    mrbc_value ary = mrbc_array_new(vm, n + 1);
+    if (ary.tt != MRBC_TT_ARRAY || !ary.array) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+    int beg = 0;
+    for (int i = 0; i < n; i++) {
+        int at = nth_hit(&s, p, len, &h, i, beg);
+        if (push_field(vm, &ary, p + beg, at - beg) < 0) {
+            mrbc_decref(&ary);
+            return;
+        }
+        beg = at + s.len;
+    }
+    if ((limit != 0 || beg < len) && push_field(vm, &ary, p + beg, len - beg) < 0) {
+        mrbc_decref(&ary);
+        return;
+    }
+    if (limit == 0) {
+        /* drop trailing empty fields */
+        while (ary.array->n_stored > 0) {
+            mrbc_value *tail = &ary.array->data[ary.array->n_stored - 1];
+            if (tail->string->size > 0) {
+                break;
+            }
+            mrbc_decref(tail);
+            ary.array->n_stored--;
+        }
+    }
+    SET_RETURN(ary);
+}
+
+/*
+ * sub, gsub
+ */
+
+/*
+ * Expand the replacement for a match at [beg, end) into dst, or just
+ * measure it if dst is NULL. As in CRuby, \0 and \& insert the match,
+ * \` and \' the text before and after it, \\ a backslash; group
+ * references are empty, since a String pattern has no groups.
+ */
+static int expand(uint8_t *dst, const mrbc_value *repl, const uint8_t *s, int len, int beg, int end)
+{
+    const uint8_t *r = repl->string->data;
+    int rlen = repl->string->size;
+    int n = 0;
+
+    for (int i = 0; i < rlen; i++) {
+        const uint8_t *src = r + i;
+        int cnt = 1;
+
+        if (r[i] == '\\' && i + 1 < rlen) {
+            switch (r[i + 1]) {
+            case '0':
+            case '&':
+                src = s + beg;
+                cnt = end - beg;
+                break;
+            case '`':
+                src = s;
+                cnt = beg;
+                break;
+            case '\'':
+                src = s + end;
+                cnt = len - end;
+                break;
+            case '\\':
+                src = r + i + 1;
+                break;
+            default:
+                if (r[i + 1] >= '1' && r[i + 1] <= '9') {
+                    cnt = 0;
+                    break;
+                }
+                cnt = 2;
+                break;
+            }
+            i++;
+        }
+        if (dst) {
+            memcpy(dst + n, src, cnt);
+        }
+        n += cnt;
+    }
+    return n;
+}
+
+static void string_sub(mrbc_vm *vm, mrbc_value *v, int argc, int global, mrbc_func_t orig)
+{
+    if (argc != 2 || v[1].tt != MRBC_TT_STRING || v[2].tt != MRBC_TT_STRING ||
+        v[1].string->size == 0) {
+        hako_call_original(vm, v, argc, orig,
+                           MRBC_CLASS(TypeError), "no implicit conversion into String");
+        return;
+    }
+
+    const uint8_t *p = v[0].string->data;
+    int len = v[0].string->size;
+    const mrbc_value *repl = &v[2];
+    int plain = !memchr(repl->string->data, '\\', repl->string->size);
+    struct hako_search s;
+    struct hits h;
+
+    hako_search_init(&s, v[1].string->data, v[1].string->size);
+    int n = count_hits(&s, p, len, global ? len : 1, &h);
+    if (n == 0) {
+        SET_RETURN(mrbc_string_new(vm, p, len));
+        return;
+    }
+
+    /* size the result: a plain replacement is the same length each time */
+    int out_len = len - n * s.len;
+    if (plain) {
+        out_len += n * repl->string->size;
+    } else {
+        int beg = 0;
+        for (int i = 0; i < n; i++) {
+            int at = nth_hit(&s, p, len, &h, i, beg);
+            out_len += expand(NULL, repl, p, len, at, at + s.len);
+            beg = at + s.len;
+        }
+    }
+
+    mrbc_value out = mrbc_string_new(vm, NULL, out_len);
+    if (out.tt != MRBC_TT_STRING || !out.string) {
+        mrbc_raise(vm, MRBC_CLASS(NoMemoryError), "out of memory");
+        return;
+    }
+
+    uint8_t *d = out.string->data;
+    int beg = 0;
+    for (int i = 0; i < n; i++) {
+        int at = nth_hit(&s, p, len, &h, i, beg);
+        memcpy(d, p + beg, at - beg);
+        d += at - beg;
+        if (plain) {
+            memcpy(d, repl->string->data, repl->string->size);
+            d += repl->string->size;
+        } else {
+            d += expand(d, repl, p, len, at, at + s.len);
+        }
+        beg = at + s.len;
+    }
+    memcpy(d, p + beg, len - beg);
+    out.string->data[out_len] = '\0';
+    SET_RETURN(out);
+}
+
+static void c_string_sub(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    string_sub(vm, v, argc, 0, orig_sub);
+}
+
+static void c_string_gsub(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    string_sub(vm, v, argc, 1, orig_gsub);
+}
+
+/**
+ * Initialize the string search extension
+ */
+void mrbc_string_search_init(void)
+{
+    static const struct {
+        const char *name;
+        mrbc_func_t func;
+        mrbc_func_t *orig;
+    } methods[] = {
+        { "index", c_string_index, &orig_index },
+        { "include?", c_string_include_p, &orig_include_p },
+        { "start_with?", c_string_start_with_p, &orig_start_with_p },
+        { "end_with?", c_string_end_with_p, &orig_end_with_p },
+        { "split", c_string_split, &orig_split },
+        { "sub", c_string_sub, &orig_sub },
+        { "gsub", c_string_gsub, &orig_gsub },
+    };
+
+    for (int i = 0; i < ARRAY_SIZE(methods); i++) {
+        *methods[i].orig = hako_find_c_method(MRBC_CLASS(String), methods[i].name);
+        mrbc_define_method(0, MRBC_CLASS(String), methods[i].name, methods[i].func);
+    }
+
+    LOG_DBG("String search registered");
+}
+
+/* After regexp, so sub, gsub and split with a Regexp still reach it */
+HAKO_EXTENSION_DEFINE(string_search, mrbc_string_search_init, HAKO_EXTENSION_PRIORITY_LATE);
@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file delta.h
+ * @brief HAKO delta updates for bytecode images stored on a filesystem
+ *
+ * A delta describes a new bytecode image as a sequence of COPY ranges
+ * from the installed image and INSERT runs of literal bytes. Deltas are
+ * produced on the host by scripts/hako_mkdelta.py.
+ *
+ * Delta layout (all integers little-endian):
+ *
+ *   offset  size  field
+ *        0     4  magic "HKDL"
+ *        4     1  version (1)
+ *        5     3  reserved (0)
+ *        8     4  size of the source image
+ *       12     4  size of the target image
+ *       16    32  SHA-256 of the source image
+ *       48    32  SHA-256 of the target image
+ *       80     -  operations, terminated by END
+ *
+ *   0x00 END
+ *   0x01 COPY    u32 offset, u32 length   (bytes from the source image)
+ *   0x02 INSERT  u32 length, data[length] (bytes from the delta)
+ */
+
+#ifndef HAKO_DELTA_H
+#define HAKO_DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define HAKO_DELTA_MAGIC "HKDL"
+#define HAKO_DELTA_VERSION 1
+#define HAKO_DELTA_HEADER_SIZE 80
+
+#define HAKO_DELTA_OP_END 0x00
+#define HAKO_DELTA_OP_COPY 0x01
+#define HAKO_DELTA_OP_INSERT 0x02
+
+/**
+ * @brief Apply a delta file to a bytecode image
+ *
+ * Streams @p base_path and @p delta_path through a buffer of
+ * CONFIG_HAKO_DELTA_BUFFER_SIZE bytes and writes the result to
+ * @p out_path. Both the source and the result are checked against the
+ * SHA-256 digests in the delta header; on any error @p out_path is removed.
+ *
+ * @param base_path Installed image the delta was made against
+ * @param delta_path Delta file
+ * @param out_path Path for the patched image (must differ from base_path)
+ * @return 0 on success, -EBADMSG for a malformed delta, -EILSEQ on a
+ *         hash mismatch, other negative error codes on I/O failure
+ */
+int hako_delta_apply(const char *base_path, const char *delta_path,
+                     const char *out_path);
+
+/**
+ * @brief Update an installed module from a delta and reload it
+ *
+ * Patches @p image_path into a temporary "<image_path>.new", renames it
+ * over @p image_path (atomic on LittleFS), then reads the new image into
+ * heap memory and hands it to hako_reload_module(). If any step before
+ * the rename fails, the installed image is left untouched.
+ *
+ * @param name Module name in the loader registry
+ * @param image_path Installed bytecode image for the module
+ * @param delta_path Delta file to apply
+ * @return 0 on success, negative error code on failure
+ */
+int hako_delta_update(const char *name, const char *image_path,
+                      const char *delta_path);
+
+/**
+ * @brief Load a bytecode image from the filesystem into the VM
+ *
+ * Reads @p image_path into heap memory, registers it under @p name and
+ * runs it, like hako_load_bytecode(). Used at boot for images that are
+ * later updated with hako_delta_update().
+ *
+ * @param name Module name in the loader registry
+ * @param image_path Bytecode image file
+ * @return 0 on success, negative error code on failure
+ */
+int hako_load_image(const char *name, const char *image_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAKO_DELTA_H */
@@ -54,6 +54,22 @@ int hako_load_registry(const struct hako_bytecode_entry *registry, size_t count)
  */
 int hako_load_bytecode(const char *name, const uint8_t *bytecode);
 
+/**
+ * @brief Run library bytecode to completion
+ *
+ * For Ruby code an extension ships, such as method definitions. Unlike
+ * hako_load_bytecode(), the code does not run in a task. Called from an
+ * extension's init function, it runs once every extension is initialized
+ * and interrupts are unlocked, still inside hako_init(); otherwise it runs
+ * before this returns. All libraries share one VM.
+ *
+ * @param name Library name (for logging)
+ * @param bytecode Pointer to mruby bytecode array; must stay valid
+ * @return 0 on success (or once queued from extension init), negative
+ *         error code on failure
+ */
+int hako_load_library(const char *name, const uint8_t *bytecode);
+
 /**
  * @brief Run the Ruby VM
  *
@@ -75,6 +91,51 @@ int hako_run(void);
  */
 const uint8_t *hako_find_bytecode(const char *name);
 
+/**
+ * @brief Replace a module's code in the running VM
+ *
+ * Points the registry entry for @p name at @p bytecode (adding it if the
+ * module is not registered yet) and runs the new top-level code in a
+ * high-priority task. Its class bodies redefine the methods and constants
+ * they declare; running tasks, instances and globals are left alone.
+ * Other tasks can run while a long module loads, so the replacement is
+ * not atomic. Called outside the VM thread, the reload is queued to it
+ * and this function waits for the result.
+ * Also available from Ruby as VM.reload(name, bytecode).
+ *
+ * The bytecode must stay valid for the lifetime of the VM, since loaded
+ * ireps and symbol names point into it.
+ *
+ * @param name Module name as used in the registry
+ * @param bytecode Pointer to the new mruby bytecode
+ * @return 0 on success, negative error code on failure
+ */
+int hako_reload_module(const char *name, const uint8_t *bytecode);
+
+/**
+ * @brief Boot timing breakdown (CONFIG_HAKO_BOOT_STATS)
+ *
+ * All values are in microseconds. first_insn_us is measured from entry
+ * to hako_init() until the VM thread starts executing Ruby code.
+ */
+struct hako_boot_stats {
+    uint32_t vm_init_us;        /**< mrbc_init() */
+    uint32_t core_methods_us;   /**< Core method registration */
+    uint32_t extensions_us;     /**< hako_init_extensions() */
+    uint32_t registry_us;       /**< hako_load_registry() */
+    uint32_t load_us;           /**< Parsing bytecode into tasks */
+    uint32_t libraries_us;      /**< Extension libraries run by hako_load_library() */
+    uint32_t first_insn_us;     /**< hako_init() to first Ruby instruction */
+};
+
+/**
+ * @brief Get boot timing statistics
+ *
+ * @return Pointer to the statistics, or NULL if CONFIG_HAKO_BOOT_STATS
+ *         is disabled
+ */
+const struct hako_boot_stats *hako_get_boot_stats(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file method.h
+ * @brief Helpers for extensions that replace built-in methods
+ *
+ * An extension that handles only some calls to a method looks up the
+ * method it replaces before defining its own, then hands the other
+ * calls to it. Extensions replacing each other's methods must be
+ * registered with priorities that order them; the one that runs later
+ * wraps the other.
+ */
+
+#ifndef HAKO_METHOD_H
+#define HAKO_METHOD_H
+
+#include <mrubyc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Find the C function currently defined for a method
+ *
+ * @param cls Class to search, including its superclasses
+ * @param name Method name
+ * @return The function, or NULL if the method is undefined or in Ruby
+ */
+static inline mrbc_func_t hako_find_c_method(mrbc_class *cls, const char *name)
+{
+    mrbc_method m;
+
+    if (mrbc_find_method(&m, cls, mrbc_str_to_symid(name)) && m.c_func) {
+        return m.func;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Hand a call to the method that was replaced
+ *
+ * @param vm VM
+ * @param v Receiver and arguments, as passed to the replacing method
+ * @param argc Argument count
+ * @param orig Function from hako_find_c_method(), or NULL
+ * @param err Exception class raised when there is no function
+ * @param msg Message of that exception
+ */
+static inline void hako_call_original(mrbc_vm *vm, mrbc_value *v, int argc, mrbc_func_t orig,
+                                      mrbc_class *err, const char *msg)
+{
+    if (orig) {
+        orig(vm, v, argc);
+    } else {
+        mrbc_raise(vm, err, msg);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAKO_METHOD_H */
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Create and apply HAKO bytecode deltas.
+
+A delta rebuilds a new .mrb image from the one installed on the device
+using COPY ranges of the old image and INSERT runs of new bytes. The
+format is documented in include/hako/delta.h.
+
+Usage:
+    hako_mkdelta.py old.mrb new.mrb -o update.hkd
+    hako_mkdelta.py --apply old.mrb update.hkd -o new.mrb
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+MAGIC = b"HKDL"
+VERSION = 1
+HEADER = struct.Struct("<4sB3xII32s32s")
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+# Shortest match worth a COPY (9 bytes of op vs. inserting the data)
+BLOCK = 16
+
+
+def make_delta(old, new):
+    index = {}
+    for off in range(len(old) - BLOCK + 1):
+        index.setdefault(old[off:off + BLOCK], off)
+
+    ops = []
+    literal = bytearray()
+    pos = 0
+    while pos < len(new):
+        off = index.get(new[pos:pos + BLOCK])
+        if off is None:
+            literal.append(new[pos])
+            pos += 1
+            continue
+
+        length = BLOCK
+        while (pos + length < len(new) and off + length < len(old)
+               and new[pos + length] == old[off + length]):
+            length += 1
+
+        if literal:
+            ops.append((OP_INSERT, bytes(literal)))
+            literal = bytearray()
+        ops.append((OP_COPY, off, length))
+        pos += length
+
+    if literal:
+        ops.append((OP_INSERT, bytes(literal)))
+
+    out = bytearray(HEADER.pack(MAGIC, VERSION, len(old), len(new),
+                                hashlib.sha256(old).digest(),
+                                hashlib.sha256(new).digest()))
+    for op in ops:
+        if op[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, op[1], op[2])
+        else:
+            out += struct.pack("<BI", OP_INSERT, len(op[1])) + op[1]
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply_delta(old, delta):
+    magic, version, src_size, dst_size, src_hash, dst_hash = \
+        HEADER.unpack_from(delta)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a version %d delta" % VERSION)
+    if len(old) != src_size or hashlib.sha256(old).digest() != src_hash:
+        raise ValueError("base image does not match delta")
+
+    new = bytearray()
+    pos = HEADER.size
+    while True:
+        op = delta[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            off, length = struct.unpack_from("<II", delta, pos)
+            pos += 8
+            new += old[off:off + length]
+        elif op == OP_INSERT:
+            (length,) = struct.unpack_from("<I", delta, pos)
+            pos += 4
+            new += delta[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError("bad opcode 0x%02x at %d" % (op, pos - 1))
+
+    if len(new) != dst_size or hashlib.sha256(new).digest() != dst_hash:
+        raise ValueError("patched image does not match delta")
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--apply", action="store_true",
+                        help="apply DELTA to OLD instead of creating one")
+    parser.add_argument("old", help="installed image")
+    parser.add_argument("new", help="new image (or delta with --apply)")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    try:
+        result = apply_delta(old, new) if args.apply else make_delta(old, new)
+    except ValueError as e:
+        sys.exit("hako_mkdelta: %s" % e)
+
+    with open(args.output, "wb") as f:
+        f.write(result)
+
+    if not args.apply:
+        print("%s: %d bytes (new image %d bytes)" %
+              (args.output, len(result), len(new)))
+
+
+if __name__ == "__main__":
+    main()
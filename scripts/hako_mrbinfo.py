@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: Apache-2.0
+"""Report register usage of compiled .mrb files.
+
+Each method, block and class body runs in a window of the task's
+register stack (CONFIG_HAKO_MAX_REGS_SIZE). A call places the callee's
+window at the register of the send, so the stack a call chain needs is
+the sum of the send registers along the chain plus the last frame's
+nregs. This lists both per irep to help size the stack.
+
+Usage:
+    hako_mrbinfo.py app.mrb [more.mrb ...]
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+OPS_H = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "ext",
+                     "picoruby", "mruby-compiler2", "include", "mrc_ops.h")
+
+# instruction sizes by operand format: plain, EXT1, EXT2, EXT3
+SIZES = {
+    "Z": (1, 1, 1, 1),
+    "B": (2, 3, 2, 3),
+    "BB": (3, 4, 4, 5),
+    "BBB": (4, 5, 5, 6),
+    "BS": (4, 5, 4, 5),
+    "BSS": (6, 7, 6, 7),
+    "S": (3, 3, 3, 3),
+    "W": (4, 4, 4, 4),
+}
+
+SENDS = ("SEND", "SSEND", "SENDB", "SSENDB", "SUPER")
+
+
+def load_opcodes(path):
+    with open(path) as f:
+        return re.findall(r"^OPCODE\((\w+),\s*(\w+)\)", f.read(), re.M)
+
+
+class Irep:
+    def __init__(self):
+        self.name = None
+        self.nlocals = self.nregs = 0
+        self.call_reg = 0
+        self.syms = []
+        self.children = []
+        self.insns = []
+
+
+def parse_irep(data, pos, ops):
+    irep = Irep()
+    recsize, irep.nlocals, irep.nregs, rlen = struct.unpack_from(">IHHH", data, pos)
+    end = pos + recsize
+    cur = pos + 10
+
+    clen, ilen = struct.unpack_from(">HI", data, cur)
+    cur += 6
+    iseq = data[cur:cur + ilen]
+    cur += ilen + clen * 13
+
+    (plen,) = struct.unpack_from(">H", data, cur)
+    cur += 2
+    for _ in range(plen):
+        tt = data[cur]
+        cur += 1
+        if tt == 1:             # int32
+            cur += 4
+        elif tt in (3, 5):      # int64, float
+            cur += 8
+        elif tt == 7:           # bigint
+            cur += data[cur] + 2
+        else:                   # string
+            (n,) = struct.unpack_from(">H", data, cur)
+            cur += 2 + n + 1
+
+    (slen,) = struct.unpack_from(">H", data, cur)
+    cur += 2
+    for _ in range(slen):
+        (n,) = struct.unpack_from(">H", data, cur)
+        cur += 2
+        if n == 0xFFFF:
+            irep.syms.append(None)
+        else:
+            irep.syms.append(data[cur:cur + n].decode("utf-8", "replace"))
+            cur += n + 1
+
+    decode(irep, iseq, ops)
+
+    cur = end
+    for _ in range(rlen):
+        child, cur = parse_irep(data, cur, ops)
+        irep.children.append(child)
+    return irep, cur
+
+
+def decode(irep, iseq, ops):
+    pc = 0
+    ext = 0
+    while pc < len(iseq):
+        name, fmt = ops[iseq[pc]]
+        if name in ("EXT1", "EXT2", "EXT3"):
+            ext = int(name[3])
+            pc += 1
+            continue
+        size = SIZES[fmt][ext]
+        operands = iseq[pc + 1:pc + size]
+        wide_a = ext in (1, 3)
+        a = (operands[0] << 8 | operands[1]) if wide_a and operands else \
+            (operands[0] if operands else 0)
+        b_off = 2 if wide_a else 1
+        b = operands[b_off] if len(operands) > b_off else 0
+        if name in SENDS and a > irep.call_reg:
+            irep.call_reg = a
+        irep.insns.append((name, a, b))
+        pc += size
+        ext = 0
+
+
+def name_children(irep, owner):
+    pending = cls = None
+    bodies = set()
+    for name, a, b in irep.insns:
+        if name == "METHOD":
+            pending = b
+        elif name == "DEF" and pending is not None:
+            meth = irep.syms[b]
+            irep.children[pending].name = "%s#%s" % (owner, meth) if owner else meth
+            pending = None
+        elif name in ("CLASS", "MODULE"):
+            cls = irep.syms[b]
+        elif name == "EXEC" and cls is not None:
+            irep.children[b].name = cls
+            bodies.add(b)
+            cls = None
+    for i, child in enumerate(irep.children):
+        if child.name is None:
+            child.name = "block in %s" % irep.name
+        name_children(child, child.name if i in bodies else owner)
+
+
+def walk(irep):
+    yield irep
+    for child in irep.children:
+        yield from walk(child)
+
+
+def report(path, ops):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"RITE":
+        raise ValueError("not a RITE binary")
+    pos = 20
+    while pos < len(data):
+        ident, size = data[pos:pos + 4], struct.unpack_from(">I", data, pos + 4)[0]
+        if ident == b"IREP":
+            root, _ = parse_irep(data, pos + 12, ops)
+            break
+        if ident == b"END\0" or size == 0:
+            raise ValueError("no IREP section")
+        pos += size
+    root.name = "top"
+    name_children(root, None)
+
+    print(path)
+    print("  %5s %7s %6s  %s" % ("nregs", "nlocals", "call@", "irep"))
+    ireps = list(walk(root))
+    for irep in ireps:
+        print("  %5d %7d %6d  %s" % (irep.nregs, irep.nlocals, irep.call_reg, irep.name))
+    big = max(ireps, key=lambda i: i.nregs)
+    print("  largest frame: %d registers (%s)" % (big.nregs, big.name))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="+", help=".mrb files")
+    args = parser.parse_args()
+
+    ops = load_opcodes(OPS_H)
+    for path in args.files:
+        try:
+            report(path, ops)
+        except (ValueError, struct.error, IndexError) as e:
+            sys.exit("hako_mrbinfo: %s: %s" % (path, e))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,429 @@
+/* SPDX-License-Identifier: Apache-2.0 */
+/**
+ * @file delta.c
+ * @brief HAKO delta updates for bytecode images stored on a filesystem
+ */
+
+#include <hako/delta.h>
+#include <hako/loader.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fs.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <psa/crypto.h>
+#include <string.h>
+
+#ifndef CONFIG_HAKO_DELTA_BUFFER_SIZE
+#define CONFIG_HAKO_DELTA_BUFFER_SIZE 256
+#endif
+
+#define DELTA_BUFFER_SIZE CONFIG_HAKO_DELTA_BUFFER_SIZE
+#define DELTA_PATH_MAX 128
+#define SHA256_SIZE 32
+
+LOG_MODULE_REGISTER(hako_delta, CONFIG_HAKO_LOG_LEVEL);
+
+struct delta_header {
+    uint32_t src_size;
+    uint32_t dst_size;
+    uint8_t src_hash[SHA256_SIZE];
+    uint8_t dst_hash[SHA256_SIZE];
+};
+
+/* Only one update runs at a time, so the stream buffer is shared. */
+static K_MUTEX_DEFINE(g_delta_mutex);
+static uint8_t g_delta_buf[DELTA_BUFFER_SIZE];
+
+static int read_exact(struct fs_file_t *file, void *dst, size_t len)
+{
+    uint8_t *p = dst;
+
+    while (len > 0) {
+        ssize_t n = fs_read(file, p, len);
+        if (n < 0) {
+            return (int)n;
+        }
+        if (n == 0) {
+            return -EBADMSG;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int write_exact(struct fs_file_t *file, const void *src, size_t len)
+{
+    const uint8_t *p = src;
+
+    while (len > 0) {
+        ssize_t n = fs_write(file, p, len);
+        if (n < 0) {
+            return (int)n;
+        }
+        if (n == 0) {
+            return -ENOSPC;
+        }
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int read_u32(struct fs_file_t *file, uint32_t *value)
+{
+    uint8_t raw[4];
+    int ret = read_exact(file, raw, sizeof(raw));
+
+    if (ret == 0) {
+        *value = sys_get_le32(raw);
+    }
+    return ret;
+}
+
+static int read_header(struct fs_file_t *delta, struct delta_header *hdr)
+{
+    uint8_t raw[HAKO_DELTA_HEADER_SIZE];
+    int ret = read_exact(delta, raw, sizeof(raw));
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (memcmp(raw, HAKO_DELTA_MAGIC, 4) != 0 || raw[4] != HAKO_DELTA_VERSION) {
+        LOG_ERR("Not a version %d delta", HAKO_DELTA_VERSION);
+        return -EBADMSG;
+    }
+
+    hdr->src_size = sys_get_le32(&raw[8]);
+    hdr->dst_size = sys_get_le32(&raw[12]);
+    memcpy(hdr->src_hash, &raw[16], SHA256_SIZE);
+    memcpy(hdr->dst_hash, &raw[48], SHA256_SIZE);
+
+    return 0;
+}
+
+static int finish_hash(psa_hash_operation_t *op, const uint8_t *expected)
+{
+    uint8_t digest[SHA256_SIZE];
+    size_t digest_len;
+
+    if (psa_hash_finish(op, digest, sizeof(digest), &digest_len) != PSA_SUCCESS) {
+        return -EIO;
+    }
+
+    return memcmp(digest, expected, SHA256_SIZE) == 0 ? 0 : -EILSEQ;
+}
+
+/* Hash the whole installed image before using it as a COPY source. */
+static int verify_source(struct fs_file_t *src, const struct delta_header *hdr)
+{
+    psa_hash_operation_t op = PSA_HASH_OPERATION_INIT;
+    uint32_t remaining = hdr->src_size;
+    int ret;
+
+    if (psa_hash_setup(&op, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+        return -EIO;
+    }
+
+    while (remaining > 0) {
+        size_t chunk = MIN(remaining, DELTA_BUFFER_SIZE);
+
+        ret = read_exact(src, g_delta_buf, chunk);
+        if (ret < 0) {
+            psa_hash_abort(&op);
+            return ret;
+        }
+        if (psa_hash_update(&op, g_delta_buf, chunk) != PSA_SUCCESS) {
+            psa_hash_abort(&op);
+            return -EIO;
+        }
+        remaining -= chunk;
+    }
+
+    /* The image must not be longer than the delta expects either */
+    if (fs_read(src, g_delta_buf, 1) != 0) {
+        psa_hash_abort(&op);
+        return -EILSEQ;
+    }
+
+    return finish_hash(&op, hdr->src_hash);
+}
+
+static int emit(struct fs_file_t *out, psa_hash_operation_t *op,
+                size_t len, uint32_t *written, uint32_t limit)
+{
+    if (len > limit - *written) {
+        return -EBADMSG;
+    }
+
+    if (psa_hash_update(op, g_delta_buf, len) != PSA_SUCCESS) {
+        return -EIO;
+    }
+    *written += len;
+
+    return write_exact(out, g_delta_buf, len);
+}
+
+static int run_ops(struct fs_file_t *src, struct fs_file_t *delta,
+                   struct fs_file_t *out, const struct delta_header *hdr)
+{
+    psa_hash_operation_t op = PSA_HASH_OPERATION_INIT;
+    uint32_t written = 0;
+    int ret = 0;
+
+    if (psa_hash_setup(&op, PSA_ALG_SHA_256) != PSA_SUCCESS) {
+        return -EIO;
+    }
+
+    for (;;) {
+        uint8_t opcode;
+        uint32_t offset = 0;
+        uint32_t len;
+
+        ret = read_exact(delta, &opcode, 1);
+        if (ret < 0) {
+            break;
+        }
+
+        if (opcode == HAKO_DELTA_OP_END) {
+            break;
+        }
+
+        if (opcode == HAKO_DELTA_OP_COPY) {
+            ret = read_u32(delta, &offset);
+            if (ret < 0) {
+                break;
+            }
+        } else if (opcode != HAKO_DELTA_OP_INSERT) {
+            ret = -EBADMSG;
+            break;
+        }
+
+        ret = read_u32(delta, &len);
+        if (ret < 0) {
+            break;
+        }
+
+        if (opcode == HAKO_DELTA_OP_COPY) {
+            if (offset > hdr->src_size || len > hdr->src_size - offset) {
+                ret = -EBADMSG;
+                break;
+            }
+            ret = fs_seek(src, offset, FS_SEEK_SET);
+            if (ret < 0) {
+                break;
+            }
+        }
+
+        while (len > 0 && ret == 0) {
+            size_t chunk = MIN(len, DELTA_BUFFER_SIZE);
+            struct fs_file_t *in = (opcode == HAKO_DELTA_OP_COPY) ? src : delta;
+
+            ret = read_exact(in, g_delta_buf, chunk);
+            if (ret == 0) {
+                ret = emit(out, &op, chunk, &written, hdr->dst_size);
+            }
+            len -= chunk;
+        }
+
+        if (ret < 0) {
+            break;
+        }
+    }
+
+    if (ret < 0) {
+        psa_hash_abort(&op);
+        return ret;
+    }
+
+    if (written != hdr->dst_size) {
+        psa_hash_abort(&op);
+        return -EBADMSG;
+    }
+
+    return finish_hash(&op, hdr->dst_hash);
+}
+
+static int hako_delta_apply_locked(const char *base_path, const char *delta_path,
+                                   const char *out_path)
+{
+    struct fs_file_t src, delta, out;
+    struct delta_header hdr;
+    int ret;
+
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        LOG_ERR("PSA crypto init failed");
+        return -EIO;
+    }
+
+    fs_file_t_init(&src);
+    fs_file_t_init(&delta);
+    fs_file_t_init(&out);
+
+    ret = fs_open(&delta, delta_path, FS_O_READ);
+    if (ret < 0) {
+        LOG_ERR("Cannot open delta %s: %d", delta_path, ret);
+        return ret;
+    }
+
+    ret = read_header(&delta, &hdr);
+    if (ret < 0) {
+        goto close_delta;
+    }
+
+    ret = fs_open(&src, base_path, FS_O_READ);
+    if (ret < 0) {
+        LOG_ERR("Cannot open image %s: %d", base_path, ret);
+        goto close_delta;
+    }
+
+    ret = verify_source(&src, &hdr);
+    if (ret < 0) {
+        LOG_ERR("Image %s does not match delta base: %d", base_path, ret);
+        goto close_src;
+    }
+
+    ret = fs_open(&out, out_path, FS_O_CREATE | FS_O_WRITE);
+    if (ret < 0) {
+        LOG_ERR("Cannot create %s: %d", out_path, ret);
+        goto close_src;
+    }
+
+    ret = fs_truncate(&out, 0);
+    if (ret == 0) {
+        ret = run_ops(&src, &delta, &out, &hdr);
+    }
+    if (ret == 0) {
+        ret = fs_sync(&out);
+    }
+    fs_close(&out);
+
+    if (ret < 0) {
+        LOG_ERR("Failed to apply delta %s: %d", delta_path, ret);
+        fs_unlink(out_path);
+    }
+
+close_src:
+    fs_close(&src);
+close_delta:
+    fs_close(&delta);
+
+    return ret;
+}
+
+int hako_delta_apply(const char *base_path, const char *delta_path,
+                     const char *out_path)
+{
+    int ret;
+
+    if (!base_path || !delta_path || !out_path) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&g_delta_mutex, K_FOREVER);
+    ret = hako_delta_apply_locked(base_path, delta_path, out_path);
+    k_mutex_unlock(&g_delta_mutex);
+
+    return ret;
+}
+
+/*
+ * Read a whole image into the system heap. Once loaded the buffer is never
+ * freed, not even when a later update supersedes it: ireps keep pointing
+ * into it for their instructions and literals, the symbol table for the
+ * names it introduced, and methods the new version does not redefine
+ * still run from it.
+ */
+static int read_image(const char *path, uint8_t **image)
+{
+    struct fs_dirent entry;
+    struct fs_file_t file;
+    uint8_t *buf;
+    int ret;
+
+    ret = fs_stat(path, &entry);
+    if (ret < 0) {
+        LOG_ERR("Cannot stat %s: %d", path, ret);
+        return ret;
+    }
+
+    buf = k_malloc(entry.size);
+    if (!buf) {
+        LOG_ERR("Not enough heap for %s (%zu bytes)", path, entry.size);
+        return -ENOMEM;
+    }
+
+    fs_file_t_init(&file);
+    ret = fs_open(&file, path, FS_O_READ);
+    if (ret == 0) {
+        ret = read_exact(&file, buf, entry.size);
+        fs_close(&file);
+    }
+
+    if (ret < 0) {
+        k_free(buf);
+        return ret;
+    }
+
+    *image = buf;
+    return 0;
+}
+
+int hako_load_image(const char *name, const char *image_path)
+{
+    uint8_t *image;
+    int ret;
+
+    if (!name || !image_path) {
+        return -EINVAL;
+    }
+
+    ret = read_image(image_path, &image);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = hako_reload_module(name, image);
+    if (ret < 0) {
+        k_free(image);
+    }
+
+    return ret;
+}
+
+int hako_delta_update(const char *name, const char *image_path,
+                      const char *delta_path)
+{
+    char tmp_path[DELTA_PATH_MAX];
+    int ret;
+
+    if (!name || !image_path || !delta_path) {
+        return -EINVAL;
+    }
+
+    ret = snprintk(tmp_path, sizeof(tmp_path), "%s.new", image_path);
+    if (ret < 0 || (size_t)ret >= sizeof(tmp_path)) {
+        return -ENAMETOOLONG;
+    }
+
+    ret = hako_delta_apply(image_path, delta_path, tmp_path);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Until this rename the old image stays installed */
+    ret = fs_rename(tmp_path, image_path);
+    if (ret < 0) {
+        LOG_ERR("Cannot install %s: %d", image_path, ret);
+        fs_unlink(tmp_path);
+        return ret;
+    }
+
+    LOG_INF("Installed %s from delta %s", image_path, delta_path);
+
+    return hako_load_image(name, image_path);
+}
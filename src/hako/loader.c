@@ -22,6 +22,15 @@
 
 #define VM_STACK_SIZE CONFIG_HAKO_VM_STACK_SIZE
 
+/* Reload tasks run ahead of application tasks */
+#define RELOAD_TASK_PRIORITY 1
+
+/* Reloads waiting for the VM thread */
+#define RELOAD_QUEUE_DEPTH 4
+
+/* Reload tasks whose top level may still be running */
+#define MAX_RELOAD_TASKS 4
+
 LOG_MODULE_REGISTER(hako_loader, CONFIG_HAKO_LOG_LEVEL);
 
 /* Global bytecode registry for require() support */
@@ -40,14 +49,53 @@ static uint8_t g_memory_pool[CONFIG_HAKO_MEMORY_SIZE];
 static bool g_vm_initialized = false;
 static mrbc_vm *g_vm = NULL;
 
+#ifdef CONFIG_HAKO_BOOT_STATS
+static struct hako_boot_stats g_boot_stats;
+static uint32_t g_boot_start;
+#define BOOT_STAMP(var) uint32_t var = k_cycle_get_32()
+#define BOOT_RECORD(field, since) \
+    (g_boot_stats.field += k_cyc_to_us_floor32(k_cycle_get_32() - (since)))
+#else
+#define BOOT_STAMP(var)
+#define BOOT_RECORD(field, since)
+#endif
+
 static K_MUTEX_DEFINE(g_vm_mutex);
 K_THREAD_STACK_DEFINE(g_vm_stack, VM_STACK_SIZE);
 static struct k_thread g_vm_thread;
 static bool g_vm_thread_started;
 static bool g_core_methods_registered;
 
+/* Libraries from hako_load_library(), run once extension init is done */
+#define MAX_PENDING_LIBRARIES 8
+
+static struct {
+    const char *name;
+    const uint8_t *bytecode;
+} g_pending_libraries[MAX_PENDING_LIBRARIES];
+
+static size_t g_pending_library_count;
+static bool g_extensions_initializing;
+static mrbc_vm g_library_vm;
+static bool g_library_vm_open;
+
+/* A reload requested from outside the VM thread; the caller waits on done */
+struct reload_request {
+    const char *name;
+    const uint8_t *bytecode;
+    int result;
+    struct k_sem done;
+};
+
+K_MSGQ_DEFINE(g_reload_queue, sizeof(struct reload_request *), RELOAD_QUEUE_DEPTH,
+              sizeof(void *));
+
+/* Deleted by the VM thread once their top level has finished */
+static mrbc_tcb *g_reload_tasks[MAX_RELOAD_TASKS];
+
 static const uint8_t *hako_find_bytecode_locked(const char *name);
 static int hako_load_bytecode_locked(const char *name, const uint8_t *bytecode);
+static int hako_reload_module_locked(const char *name, const uint8_t *bytecode);
 static void hako_register_core_methods(void);
 int hako_start_vm_thread(void);
 void hako_vm_thread(void *p1, void *p2, void *p3);
@@ -65,9 +113,18 @@ int hako_init(void)
         return 0;
     }
 
+#ifdef CONFIG_HAKO_BOOT_STATS
+    g_boot_start = k_cycle_get_32();
+#endif
+
     /* Initialize mruby/c VM and scheduler */
+    BOOT_STAMP(t_init);
     mrbc_init(g_memory_pool, CONFIG_HAKO_MEMORY_SIZE);
+    BOOT_RECORD(vm_init_us, t_init);
+
+    BOOT_STAMP(t_methods);
     hako_register_core_methods();
+    BOOT_RECORD(core_methods_us, t_methods);
 
     g_vm_initialized = true;
     g_vm_thread_started = false;
@@ -78,7 +135,7 @@ int hako_init(void)
     LOG_INF("HAKO VM initialized (memory: %d bytes)", CONFIG_HAKO_MEMORY_SIZE);
 
     /* Auto-discover and initialize extensions */
-    //hako_init_extensions();
+    hako_init_extensions();
 
     return 0;
 }
@@ -99,6 +156,7 @@ int hako_load_registry(const struct hako_bytecode_entry *registry, size_t count)
     }
 
     LOG_INF("Loading bytecode registry: %zu modules", count);
+    BOOT_STAMP(t_registry);
 
     for (size_t i = 0; i < count && registry[i].name != NULL; i++) {
         const char *name = registry[i].name;
@@ -122,6 +180,7 @@ int hako_load_registry(const struct hako_bytecode_entry *registry, size_t count)
 
         LOG_DBG("Registered module: %s", name);
     }
+    BOOT_RECORD(registry_us, t_registry);
 
     k_mutex_unlock(&g_vm_mutex);
 
@@ -152,6 +211,80 @@ int hako_load_bytecode(const char *name, const uint8_t *bytecode)
     return ret;
 }
 
+/* Runs one library in the shared library VM; call with g_vm_mutex held */
+static int hako_run_library_locked(const char *name, const uint8_t *bytecode)
+{
+    int ret = 0;
+
+    /*
+     * One VM, never closed, for every library: the methods a library
+     * defines point into its irep, which mrbc_vm_close() would free.
+     */
+    if (!g_library_vm_open) {
+        if (!mrbc_vm_open(&g_library_vm)) {
+            LOG_ERR("Failed to open VM for %s", name);
+            return -ENOMEM;
+        }
+        g_library_vm_open = true;
+    }
+
+    BOOT_STAMP(t_library);
+    if (mrbc_load_mrb(&g_library_vm, bytecode) != 0) {
+        LOG_ERR("Failed to load %s", name);
+        ret = -EINVAL;
+    } else {
+        mrbc_vm_begin(&g_library_vm);
+        /* returns 0 if preempted before the code is done */
+        while (mrbc_vm_run(&g_library_vm) == 0) {
+        }
+        if (mrbc_israised(&g_library_vm)) {
+            LOG_ERR("Exception while loading %s", name);
+            ret = -EIO;
+        }
+        mrbc_vm_end(&g_library_vm);
+    }
+    BOOT_RECORD(libraries_us, t_library);
+
+    if (ret == 0) {
+        LOG_INF("Loaded library: %s", name);
+    }
+    return ret;
+}
+
+int hako_load_library(const char *name, const uint8_t *bytecode)
+{
+    int ret;
+
+    if (!bytecode) {
+        LOG_ERR("Invalid bytecode pointer");
+        return -EINVAL;
+    }
+
+    /* Extension init runs with interrupts locked; run it afterwards */
+    if (g_extensions_initializing) {
+        if (g_pending_library_count >= MAX_PENDING_LIBRARIES) {
+            LOG_ERR("Too many libraries (max %d)", MAX_PENDING_LIBRARIES);
+            return -ENOMEM;
+        }
+        g_pending_libraries[g_pending_library_count].name = name;
+        g_pending_libraries[g_pending_library_count].bytecode = bytecode;
+        g_pending_library_count++;
+        return 0;
+    }
+
+    k_mutex_lock(&g_vm_mutex, K_FOREVER);
+    if (!g_vm_initialized) {
+        k_mutex_unlock(&g_vm_mutex);
+        LOG_ERR("VM not initialized");
+        return -EINVAL;
+    }
+
+    ret = hako_run_library_locked(name, bytecode);
+    k_mutex_unlock(&g_vm_mutex);
+
+    return ret;
+}
+
 int hako_run(void)
 {
     return hako_start_vm_thread();
@@ -168,6 +301,44 @@ const uint8_t *hako_find_bytecode(const char *name)
     return bytecode;
 }
 
+int hako_reload_module(const char *name, const uint8_t *bytecode)
+{
+    int ret;
+
+    k_mutex_lock(&g_vm_mutex, K_FOREVER);
+    if (!g_vm_initialized) {
+        k_mutex_unlock(&g_vm_mutex);
+        LOG_ERR("VM not initialized");
+        return -EINVAL;
+    }
+
+    if (!name || !bytecode) {
+        k_mutex_unlock(&g_vm_mutex);
+        LOG_ERR("Invalid module name or bytecode pointer");
+        return -EINVAL;
+    }
+
+    if (!g_vm_thread_started || k_current_get() == &g_vm_thread) {
+        ret = hako_reload_module_locked(name, bytecode);
+        k_mutex_unlock(&g_vm_mutex);
+        return ret;
+    }
+    k_mutex_unlock(&g_vm_mutex);
+
+    /* The scheduler is not thread safe: let the VM thread create the task */
+    struct reload_request req = { .name = name, .bytecode = bytecode };
+    struct reload_request *p = &req;
+
+    k_sem_init(&req.done, 0, 1);
+    ret = k_msgq_put(&g_reload_queue, &p, K_FOREVER);
+    if (ret < 0) {
+        return ret;
+    }
+    k_sem_take(&req.done, K_FOREVER);
+
+    return req.result;
+}
+
 /* Extension auto-initialization */
 
 /* Linker symbols for .hako_extensions section */
@@ -179,6 +350,7 @@ void hako_init_extensions(void)
     unsigned int key = irq_lock();
     struct hako_extension_entry *ext;
     size_t count = 0;
+    BOOT_STAMP(t_ext);
 
     LOG_INF("Discovering HAKO extensions...");
 
@@ -187,15 +359,47 @@ void hako_init_extensions(void)
     }
     LOG_INF("Found %zu extension(s)", count);
 
-    /* původní priority loop pryč */
-    for (ext = __hako_extensions_start; ext < __hako_extensions_end; ext++) {
-        LOG_DBG("Initializing extension: %s (priority %d)",
-                ext->name, ext->priority);
-        ext->init();
+    g_extensions_initializing = true;
+
+    /*
+     * The section is in link order, so walk it once per priority level,
+     * lowest first. Entries of one level run in link order.
+     */
+    int prio = -1;
+    for (;;) {
+        int next = UINT8_MAX + 1;
+
+        for (ext = __hako_extensions_start; ext < __hako_extensions_end; ext++) {
+            if (ext->priority > prio && ext->priority < next) {
+                next = ext->priority;
+            }
+        }
+        if (next > UINT8_MAX) {
+            break;
+        }
+
+        for (ext = __hako_extensions_start; ext < __hako_extensions_end; ext++) {
+            if (ext->priority == next) {
+                LOG_DBG("Initializing extension: %s (priority %d)",
+                        ext->name, ext->priority);
+                ext->init();
+            }
+        }
+        prio = next;
     }
 
+    g_extensions_initializing = false;
+
+    BOOT_RECORD(extensions_us, t_ext);
     LOG_INF("All extensions initialized");
     irq_unlock(key);
+
+    k_mutex_lock(&g_vm_mutex, K_FOREVER);
+    for (size_t i = 0; i < g_pending_library_count; i++) {
+        hako_run_library_locked(g_pending_libraries[i].name, g_pending_libraries[i].bytecode);
+    }
+    g_pending_library_count = 0;
+    k_mutex_unlock(&g_vm_mutex);
 }
 
 mrbc_vm *hako_get_vm(void)
@@ -209,6 +413,15 @@ mrbc_vm *hako_get_vm(void)
     return vm;
 }
 
+const struct hako_boot_stats *hako_get_boot_stats(void)
+{
+#ifdef CONFIG_HAKO_BOOT_STATS
+    return &g_boot_stats;
+#else
+    return NULL;
+#endif
+}
+
 static const uint8_t *hako_find_bytecode_locked(const char *name)
 {
     if (!name) {
@@ -228,7 +441,9 @@ static const uint8_t *hako_find_bytecode_locked(const char *name)
 
 static int hako_load_bytecode_locked(const char *name, const uint8_t *bytecode)
 {
+    BOOT_STAMP(t_load);
     mrbc_tcb *tcb = mrbc_create_task(bytecode, NULL);
+    BOOT_RECORD(load_us, t_load);
     if (!tcb) {
         LOG_ERR("Failed to create task for %s", name ? name : "<unknown>");
         return -ENOMEM;
@@ -246,6 +461,130 @@ static int hako_load_bytecode_locked(const char *name, const uint8_t *bytecode)
     return 0;
 }
 
+static int hako_reload_module_locked(const char *name, const uint8_t *bytecode)
+{
+    size_t i;
+
+    for (i = 0; i < g_bytecode_count; i++) {
+        if (strcmp(g_bytecode_registry[i].name, name) == 0) {
+            break;
+        }
+    }
+
+    if (i == g_bytecode_count && g_bytecode_count >= MAX_BYTECODE_MODULES) {
+        LOG_ERR("Bytecode registry full (max %d modules)", MAX_BYTECODE_MODULES);
+        return -ENOMEM;
+    }
+
+    size_t slot;
+    for (slot = 0; slot < MAX_RELOAD_TASKS; slot++) {
+        if (!g_reload_tasks[slot]) {
+            break;
+        }
+    }
+    if (slot == MAX_RELOAD_TASKS) {
+        LOG_ERR("Too many reloads in progress (max %d)", MAX_RELOAD_TASKS);
+        return -EBUSY;
+    }
+
+    /*
+     * Running the new top-level code re-executes its class bodies, so
+     * OP_DEF/OP_SETCONST replace the old methods and constants in place.
+     * Instances, task state and globals are left untouched. The reload
+     * task runs ahead of application tasks, but it can still be preempted
+     * at a tick, so other tasks may see old and new definitions together
+     * while a long module loads. The old image stays in use: methods the
+     * new code does not redefine and the symbol table point into it.
+     */
+    mrbc_tcb *tcb = mrbc_tcb_new(MAX_REGS_SIZE, MRBC_TASK_DEFAULT_STATE,
+                                 RELOAD_TASK_PRIORITY);
+    if (!tcb) {
+        LOG_ERR("Failed to allocate reload task for %s", name);
+        return -ENOMEM;
+    }
+
+    if (!mrbc_create_task(bytecode, tcb)) {
+        LOG_ERR("Failed to create reload task for %s", name);
+        mrbc_raw_free(tcb);
+        return -ENOMEM;
+    }
+    g_reload_tasks[slot] = tcb;
+
+    if (i == g_bytecode_count) {
+        g_bytecode_registry[i].name = name;
+        g_bytecode_count++;
+    }
+    g_bytecode_registry[i].bytecode = bytecode;
+    mrbc_set_task_name(tcb, g_bytecode_registry[i].name);
+
+    LOG_INF("Reloading module: %s", name);
+    return 0;
+}
+
+/* The name the registry holds for a module, or NULL */
+static const char *hako_find_registered_name(const char *name)
+{
+    const char *found = NULL;
+
+    k_mutex_lock(&g_vm_mutex, K_FOREVER);
+    for (size_t i = 0; i < g_bytecode_count; i++) {
+        if (strcmp(g_bytecode_registry[i].name, name) == 0) {
+            found = g_bytecode_registry[i].name;
+            break;
+        }
+    }
+    k_mutex_unlock(&g_vm_mutex);
+
+    return found;
+}
+
+/*
+ * VM.reload(name, bytecode) -> true
+ *
+ * The bytecode string is copied to the heap. After a successful reload the
+ * copy stays allocated, since loaded ireps and the symbol table point into
+ * it; a failed reload frees it again.
+ */
+static void c_vm_reload(mrbc_vm *vm, mrbc_value *v, int argc)
+{
+    if (argc != 2 || v[1].tt != MRBC_TT_STRING || v[2].tt != MRBC_TT_STRING) {
+        mrbc_raise(vm, MRBC_CLASS(ArgumentError), "expected (name, bytecode) strings");
+        return;
+    }
+
+    size_t name_len = v[1].string->size;
+    size_t size = v[2].string->size;
+    char *name = mrbc_raw_alloc(name_len + 1);
+    uint8_t *bytecode = mrbc_raw_alloc(size);
+    if (!name || !bytecode) {
+        if (name) {
+            mrbc_raw_free(name);
+        }
+        if (bytecode) {
+            mrbc_raw_free(bytecode);
+        }
+        mrbc_raise(vm, MRBC_CLASS(RuntimeError), "not enough memory for reload");
+        return;
+    }
+    memcpy(name, v[1].string->data, name_len);
+    name[name_len] = '\0';
+    memcpy(bytecode, v[2].string->data, size);
+
+    if (hako_reload_module(name, bytecode) < 0) {
+        mrbc_raisef(vm, MRBC_CLASS(RuntimeError), "failed to reload module '%s'", name);
+        mrbc_raw_free(bytecode);
+        mrbc_raw_free(name);
+        return;
+    }
+
+    /* A module already registered keeps the name it had */
+    if (hako_find_registered_name(name) != name) {
+        mrbc_raw_free(name);
+    }
+
+    SET_TRUE_RETURN();
+}
+
 static void hako_register_core_methods(void)
 {
     static const struct {
@@ -300,9 +639,46 @@ static void hako_register_core_methods(void)
         }
     }
 
+    mrbc_define_method(NULL, MRBC_CLASS(VM), "reload", c_vm_reload);
+
     g_core_methods_registered = true;
 }
 
+/* Delete reload tasks that have finished; call with g_vm_mutex held */
+static void hako_delete_finished_reloads_locked(void)
+{
+    for (size_t i = 0; i < MAX_RELOAD_TASKS; i++) {
+        mrbc_tcb *tcb = g_reload_tasks[i];
+
+        if (tcb && tcb->state == TASKSTATE_DORMANT) {
+            /* The methods the module defined point into its irep; keep it */
+            tcb->vm.top_irep = NULL;
+            mrbc_delete_task(tcb);
+            g_reload_tasks[i] = NULL;
+        }
+    }
+}
+
+/*
+ * Between scheduler runs: delete reload tasks the last run finished,
+ * then apply reloads queued by other threads.
+ */
+static void hako_apply_reloads(void)
+{
+    struct reload_request *req;
+
+    k_mutex_lock(&g_vm_mutex, K_FOREVER);
+    hako_delete_finished_reloads_locked();
+    k_mutex_unlock(&g_vm_mutex);
+
+    while (k_msgq_get(&g_reload_queue, &req, K_NO_WAIT) == 0) {
+        k_mutex_lock(&g_vm_mutex, K_FOREVER);
+        req->result = hako_reload_module_locked(req->name, req->bytecode);
+        k_mutex_unlock(&g_vm_mutex);
+        k_sem_give(&req->done);
+    }
+}
+
 void hako_vm_thread(void *p1, void *p2, void *p3)
 {
     ARG_UNUSED(p1);
@@ -311,7 +687,20 @@ void hako_vm_thread(void *p1, void *p2, void *p3)
 
     uint32_t iter = 0;
 
+#ifdef CONFIG_HAKO_BOOT_STATS
+    if (g_boot_stats.first_insn_us == 0) {
+        g_boot_stats.first_insn_us = k_cyc_to_us_floor32(k_cycle_get_32() - g_boot_start);
+        LOG_INF("Boot: first Ruby instruction at %u us (vm_init %u, core_methods %u, "
+                "extensions %u, libraries %u, registry %u, load %u)",
+                g_boot_stats.first_insn_us, g_boot_stats.vm_init_us,
+                g_boot_stats.core_methods_us, g_boot_stats.extensions_us,
+                g_boot_stats.libraries_us, g_boot_stats.registry_us,
+                g_boot_stats.load_us);
+    }
+#endif
+
     while (1) {
+        hako_apply_reloads();
         mrbc_run();
         mrbc_tick();
         k_msleep(1);